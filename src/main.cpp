@@ -14,11 +14,25 @@
 *******************************************************************************/
 
 
+#include <cstdio>
+#include <unistd.h>
 #include "visual_game.hpp"
 
-int main()
+int main(int argc, char *argv[])
 {
-  tetris::visual_game tetris;
+  const char *record = nullptr;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r:h")) != -1) {
+    switch (opt) {
+    case 'r': record = optarg; break;
+    default:
+      fprintf(stderr, "usage: %s [-r replay file]\n", argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  tetris::visual_game tetris(record);
   tetris.run();
   tetris.run();
   return 0;
@@ -0,0 +1,189 @@
+/***************************************************************************//**
+
+  @file         tetris_ai.cpp
+
+  @brief        Lookahead search for where to put each piece.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_ai.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+namespace tetris{
+
+  #define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
+  #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+  /*
+    Value of a board on which the game is over.
+  */
+  constexpr double LOST = -1e30;
+
+  double tetris_ai_stats::nodes_per_sec() const
+  {
+    return seconds > 0 ? nodes / seconds : 0;
+  }
+
+  tetris_ai::tetris_ai(const tetris_ai_config &config)
+    : config(config), stamp(0), root(new tetris_placements),
+      scratch(new tetris_placements)
+  {
+    this->config.beam = MAX(this->config.beam, 1);
+    this->config.depth = MIN(MAX(this->config.depth, 1), 2 + NUM_PREVIEW);
+    table.assign(std::size_t(1) << this->config.table_bits, entry{0, 0, 0, 0});
+    beam.reserve(this->config.beam);
+  }
+
+  const tetris_placements &tetris_ai::get_root() const
+  {
+    return *root;
+  }
+
+  const tetris_ai_stats &tetris_ai::get_stats() const
+  {
+    return stats;
+  }
+
+  /*
+    Score a board with config.weights.
+  */
+  double tetris_ai::tai_evaluate(const tetris_game &game)
+  {
+    const tetris_weights &w = config.weights;
+    int r, c, height = 0, holes = 0, bumpiness = 0;
+    tetris_row covered = 0, row;
+    for (r = 0; r < game.get_rows(); r++) {
+      row = game.get_row(r);
+      holes += __builtin_popcount(covered & ~row);
+      covered |= row;
+    }
+    for (c = 0; c < game.get_cols(); c++) {
+      height += game.get_height(c);
+      if (c > 0)
+        bumpiness += std::abs(game.get_height(c) - game.get_height(c - 1));
+    }
+    return w.height * height + w.holes * holes + w.bumpiness * bumpiness;
+  }
+
+  /*
+    Put the falling piece of beam[parent] in each of the given places and add
+    the results to children.  A board already added this ply keeps whichever of
+    the two scores is better.
+  */
+  void tetris_ai::tai_expand(int parent, const tetris_placements &moves,
+                             bool first)
+  {
+    std::uint64_t mask = table.size() - 1;
+    state &from = beam[parent];
+    tetris_game &game = *from.game;
+    tetris_undo undo;
+    int i, lines;
+    for (i = 0; i < moves.get_size(); i++) {
+      child c{parent, moves.get_placement(i).block, from.reward, LOST,
+              first ? i : from.root};
+      lines = game.tg_place(c.block, undo);
+      stats.nodes++;
+      if (lines < 0) {
+        game.tg_undo(undo);
+        children.push_back(c);
+        continue;
+      }
+      c.reward += config.weights.lines * lines;
+
+      std::uint64_t key = game.get_hash();
+      entry &e = table[key & mask];
+      if (e.stamp != 0 && e.key == key) {
+        stats.hits++;
+      } else {
+        e.key = key;
+        e.eval = tai_evaluate(game);
+        e.stamp = 0;
+      }
+      c.value = c.reward + e.eval;
+      game.tg_undo(undo);
+
+      if (e.stamp == stamp) {
+        if (c.value > children[e.slot].value)
+          children[e.slot] = c;
+        continue;
+      }
+      e.stamp = stamp;
+      e.slot = children.size();
+      children.push_back(c);
+    }
+  }
+
+  /*
+    Build the best config.beam children as the new beam.
+  */
+  void tetris_ai::tai_select()
+  {
+    auto better = [](const child &a, const child &b) {
+      return a.value > b.value;
+    };
+    if ((int) children.size() > config.beam) {
+      std::nth_element(children.begin(), children.begin() + config.beam,
+                       children.end(), better);
+      children.resize(config.beam);
+    }
+    next_beam.clear();
+    for (const child &c : children) {
+      next_beam.push_back(state{arena.ta_clone(*beam[c.parent].game), c.reward,
+                                c.value, c.root});
+      next_beam.back().game->tg_place(c.block);
+    }
+    beam.swap(next_beam);
+    children.clear();
+  }
+
+  int tetris_ai::tai_search(const tetris_game &game)
+  {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start] {
+      return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    };
+    int ply, parent, best = -1;
+
+    // The boards of the last search are all dropped with it.
+    arena.ta_reset();
+    stats.searches++;
+    beam.clear();
+    children.clear();
+    beam.push_back(state{arena.ta_clone(game), 0, 0, -1});
+    for (ply = 0; ply < config.depth; ply++) {
+      bool late = false;
+      stamp = stamp + 1 ? stamp + 1 : 1;
+      for (parent = 0; parent < (int) beam.size(); parent++) {
+        const tetris_game &from = *beam[parent].game;
+        if (beam[parent].value <= LOST)
+          continue;
+        tetris_placements &moves = ply == 0 ? *root : *scratch;
+        from.tg_placements(from.get_falling(), moves);
+        tai_expand(parent, moves, ply == 0);
+        if (ply > 0 && config.budget > 0 && elapsed() > config.budget) {
+          late = true;
+          break;
+        }
+      }
+      if (late || children.empty())
+        break;
+      tai_select();
+    }
+
+    double value = LOST;
+    for (const state &s : beam) {
+      if (best < 0 || s.value > value) {
+        best = s.root;
+        value = s.value;
+      }
+    }
+    children.clear();
+    stats.seconds += elapsed();
+    return best;
+  }
+}
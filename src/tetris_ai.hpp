@@ -0,0 +1,133 @@
+/***************************************************************************//**
+
+  @file         tetris_ai.hpp
+
+  @brief        Lookahead search for where to put each piece.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_arena.hpp"
+#include "tetris_game.hpp"
+#include "tetris_placement.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tetris{
+
+  /*
+    Weights of the board evaluation.  A board scores the sum of each feature
+    times its weight; lines is paid for every line a placement clears.
+  */
+  struct tetris_weights {
+    double height = -0.51;      // sum of the column heights
+    double lines = 0.76;        // lines cleared
+    double holes = -0.36;       // empty cells with a filled cell above them
+    double bumpiness = -0.18;   // sum of height steps between neighbours
+  };
+
+  struct tetris_ai_config {
+    /*
+      Boards kept after each ply.
+    */
+    int beam = 32;
+    /*
+      Pieces searched: the falling one, then next, then the preview, so at most
+      2 + NUM_PREVIEW.
+    */
+    int depth = 2;
+    /*
+      Seconds a search may take, or 0 for no limit.  The first ply is always
+      finished; later ones are dropped if time runs out during them.
+    */
+    double budget = 0;
+    /*
+      The transposition table has 2^table_bits entries.
+    */
+    int table_bits = 16;
+    tetris_weights weights;
+  };
+
+  struct tetris_ai_stats {
+    long searches = 0;
+    long nodes = 0;
+    /*
+      Evaluations answered by the transposition table.
+    */
+    long hits = 0;
+    double seconds = 0;
+
+    double nodes_per_sec() const;
+  };
+
+  /*
+    Beam search over placements.  Each ply puts the next piece in every place
+    tg_placements finds on every board in the beam, scores the results, and
+    keeps the best config.beam of them.  Boards are keyed by their Zobrist hash
+    in a fixed-size table that remembers their evaluation across searches, and
+    within a ply it also merges boards reached by placing pieces in a different
+    order, keeping the better score.  The boards are cloned into an arena of
+    the search's own, which each search resets, so a search makes no calls to
+    the global allocator once the arena has grown to size.
+  */
+  class tetris_ai {
+
+    private:
+      struct entry {
+        std::uint64_t key;
+        float eval;
+        std::uint32_t stamp;
+        std::int32_t slot;
+      };
+
+      /*
+        A board in the beam, and a placement on one of them that may make the
+        next beam.  Children are scored by placing and undoing on the parent's
+        board; only the ones kept are built.
+      */
+      struct state {
+        tetris_game *game;
+        double reward;
+        double value;
+        int root;
+      };
+
+      struct child {
+        int parent;
+        tetris_block block;
+        double reward;
+        double value;
+        int root;
+      };
+
+      tetris_ai_config config;
+      tetris_ai_stats stats;
+      std::vector<entry> table;
+      std::uint32_t stamp;
+      tetris_arena arena;
+      std::vector<state> beam;
+      std::vector<state> next_beam;
+      std::vector<child> children;
+      std::unique_ptr<tetris_placements> root;
+      std::unique_ptr<tetris_placements> scratch;
+
+      double tai_evaluate(const tetris_game &game);
+      void tai_expand(int parent, const tetris_placements &moves, bool first);
+      void tai_select();
+
+    public:
+      explicit tetris_ai(const tetris_ai_config &config = tetris_ai_config());
+
+      /*
+        Search from the falling block of game.  Returns the index of the best
+        placement in get_root(), or -1 if the block has nowhere to go.
+      */
+      int tai_search(const tetris_game &game);
+      const tetris_placements &get_root() const;
+      const tetris_ai_stats &get_stats() const;
+  };
+}
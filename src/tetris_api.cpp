@@ -0,0 +1,106 @@
+/***************************************************************************//**
+
+  @file         tetris_api.cpp
+
+  @brief        C interface to the headless tetris engine.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_api.h"
+#include "tetris_game.hpp"
+#include <algorithm>
+#include <vector>
+
+using tetris::tetris_game;
+using tetris::tetris_move;
+using tetris::tetris_randomizer;
+
+struct tetris_games {
+  int rows;
+  int cols;
+  tetris_randomizer randomizer;
+  std::vector<tetris_game> games;
+  std::vector<char> running;
+};
+
+tetris_games *tgs_create(int n, int rows, int cols, unsigned long long seed,
+                         int bag)
+{
+  tetris_games *games;
+  int i;
+  if (n < 0 || !tetris::tg_valid_size(rows, cols))
+    return nullptr;
+  games = new tetris_games;
+  games->rows = rows;
+  games->cols = cols;
+  games->randomizer = bag ? tetris::TR_BAG : tetris::TR_UNIFORM;
+  games->games.reserve(n);
+  for (i = 0; i < n; i++) {
+    games->games.emplace_back(rows, cols, seed + i, games->randomizer);
+  }
+  games->running.assign(n, 1);
+  return games;
+}
+
+void tgs_destroy(tetris_games *games)
+{
+  delete games;
+}
+
+int tgs_count(const tetris_games *games)
+{
+  return games->games.size();
+}
+
+int tgs_step(tetris_games *games, const int *moves, int n)
+{
+  int i, running = 0;
+  n = std::min(n, (int) games->games.size());
+  for (i = 0; i < n; i++) {
+    if (games->running[i]) {
+      games->running[i] = games->games[i].tg_tick((tetris_move) moves[i]);
+    }
+    running += games->running[i];
+  }
+  return running;
+}
+
+void tgs_reset(tetris_games *games, int i, unsigned long long seed)
+{
+  games->games[i] = tetris_game(games->rows, games->cols, seed,
+                                games->randomizer);
+  games->running[i] = 1;
+}
+
+int tgs_running(const tetris_games *games, int i)
+{
+  return games->running[i];
+}
+
+int tgs_points(const tetris_games *games, int i)
+{
+  return games->games[i].get_points();
+}
+
+int tgs_level(const tetris_games *games, int i)
+{
+  return games->games[i].get_level();
+}
+
+int tgs_lines_remaining(const tetris_games *games, int i)
+{
+  return games->games[i].get_lines_remaining();
+}
+
+void tgs_board(const tetris_games *games, int i, char *cells)
+{
+  const tetris_game &tg = games->games[i];
+  int r, c;
+  for (r = 0; r < tg.get_rows(); r++) {
+    for (c = 0; c < tg.get_cols(); c++) {
+      *cells++ = tg.tg_get(r, c);
+    }
+  }
+}
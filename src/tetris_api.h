@@ -0,0 +1,69 @@
+/***************************************************************************//**
+
+  @file         tetris_api.h
+
+  @brief        C interface to the headless tetris engine.
+
+  A tetris_games object holds a fixed number of independent games that are
+  all advanced by a single call.  Nothing here touches the terminal, so this
+  header and libtetris are all an embedding program needs.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct tetris_games tetris_games;
+
+  /*
+    Create n games, each with a rows x cols board.  Game i is seeded with
+    seed + i.  If bag is nonzero pieces are dealt from shuffled bags of all
+    seven tetrominos, otherwise each is picked independently.  Returns NULL
+    if n is negative, rows isn't 1 to 32, or cols isn't 4 to 16.
+  */
+  tetris_games *tgs_create(int n, int rows, int cols, unsigned long long seed,
+                           int bag);
+  void tgs_destroy(tetris_games *games);
+
+  /*
+    Return how many games the object holds.
+  */
+  int tgs_count(const tetris_games *games);
+
+  /*
+    Advance games 0..n-1 by one tick each, game i receiving moves[i] (a
+    tetris_move value: 0 = left, 1 = right, 2 = clockwise, 3 = counter, 4 =
+    drop, 5 = hold, 6 = none).  Games that are already over are left alone.
+    Returns how many of games 0..n-1 are still running.  An n larger than
+    tgs_count is taken as tgs_count.
+  */
+  int tgs_step(tetris_games *games, const int *moves, int n);
+
+  /*
+    Start game i over with an empty board and the given seed.
+  */
+  void tgs_reset(tetris_games *games, int i, unsigned long long seed);
+
+  /*
+    Questions about game i.
+  */
+  int tgs_running(const tetris_games *games, int i);
+  int tgs_points(const tetris_games *games, int i);
+  int tgs_level(const tetris_games *games, int i);
+  int tgs_lines_remaining(const tetris_games *games, int i);
+
+  /*
+    Copy the cells of game i, falling block included, into cells (rows * cols
+    bytes, row-major).  Each byte is a tetris_cell value.
+  */
+  void tgs_board(const tetris_games *games, int i, char *cells);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,64 @@
+/***************************************************************************//**
+
+  @file         tetris_arena.cpp
+
+  @brief        Bump allocator for game states in a search.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_arena.hpp"
+
+namespace tetris{
+
+  tetris_arena::tetris_arena(std::size_t chunk_bytes)
+    : chunk_bytes(chunk_bytes), current(0), used(0), total(0)
+  {
+  }
+
+  void *tetris_arena::ta_alloc(std::size_t bytes, std::size_t align)
+  {
+    std::size_t start = (used + align - 1) & ~(align - 1);
+    if (current < chunks.size() && start + bytes <= chunk_bytes) {
+      used = start + bytes;
+      total += bytes;
+      return chunks[current].get() + start;
+    }
+
+    // Oversized requests get a block of their own, freed by the next reset.
+    if (bytes > chunk_bytes) {
+      large.emplace_back(new unsigned char[bytes]);
+      total += bytes;
+      return large.back().get();
+    }
+
+    // Move on to the next chunk, making one if this is the furthest we've been.
+    if (current < chunks.size())
+      current++;
+    if (current == chunks.size())
+      chunks.emplace_back(new unsigned char[chunk_bytes]);
+    used = bytes;
+    total += bytes;
+    return chunks[current].get();
+  }
+
+  void tetris_arena::ta_reset()
+  {
+    large.clear();
+    current = 0;
+    used = 0;
+    total = 0;
+  }
+
+  std::size_t tetris_arena::get_used() const
+  {
+    return total;
+  }
+
+  tetris_arena &ta_local()
+  {
+    static thread_local tetris_arena arena;
+    return arena;
+  }
+}
@@ -0,0 +1,91 @@
+/***************************************************************************//**
+
+  @file         tetris_arena.hpp
+
+  @brief        Bump allocator for game states in a search.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tetris{
+
+  /*
+    Hands out memory from large chunks, one after another, and takes it all back
+    at once with ta_reset.  The chunks are kept for reuse, so a search that
+    resets its arena between moves stops touching the global allocator once
+    it has grown to size.  Objects in an arena are never destroyed, so only
+    trivially destructible types go in; tetris_game is one, and copying it is a
+    plain memcpy.  An arena is for one thread; ta_local gives each thread its
+    own.
+  */
+  class tetris_arena {
+
+    private:
+      std::size_t chunk_bytes;
+      std::vector<std::unique_ptr<unsigned char[]>> chunks;
+      std::vector<std::unique_ptr<unsigned char[]>> large;
+      /*
+        Chunk being allocated from, how much of it is used, and how much has
+        been handed out in all.
+      */
+      std::size_t current;
+      std::size_t used;
+      std::size_t total;
+
+    public:
+      explicit tetris_arena(std::size_t chunk_bytes = 1 << 20);
+      tetris_arena(const tetris_arena &) = delete;
+      tetris_arena &operator=(const tetris_arena &) = delete;
+
+      /*
+        Return bytes of memory aligned to align (a power of two, at most
+        alignof(std::max_align_t)).  Requests larger than a chunk are given
+        their own block from the global allocator.
+      */
+      void *ta_alloc(std::size_t bytes, std::size_t align);
+      /*
+        Forget everything allocated so far.
+      */
+      void ta_reset();
+      /*
+        Bytes handed out since the last reset.
+      */
+      std::size_t get_used() const;
+
+      template <typename T, typename... Args>
+      T *ta_create(Args &&... args)
+      {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "arena objects are never destroyed");
+        return new (ta_alloc(sizeof(T), alignof(T)))
+          T(std::forward<Args>(args)...);
+      }
+
+      /*
+        Copy a state into the arena.  For a trivially copyable T the copy
+        constructor is a memcpy.
+      */
+      template <typename T>
+      T *ta_clone(const T &value)
+      {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "clones are plain memory copies");
+        return ta_create<T>(value);
+      }
+  };
+
+  /*
+    The calling thread's arena.
+  */
+  tetris_arena &ta_local();
+}
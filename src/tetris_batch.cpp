@@ -0,0 +1,746 @@
+/***************************************************************************//**
+
+  @file         tetris_batch.cpp
+
+  @brief        Many tetris games stepped in lockstep.
+
+  The per-game logic below mirrors tetris_game.cpp function for function, only
+  with the state spread across parallel arrays.  Any change to the rules there
+  has to be made here too.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_batch.hpp"
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TB_X86 1
+#endif
+
+namespace tetris{
+
+  #define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
+  #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+  /*
+    What gravity does to a game during one tick.
+  */
+  enum {
+    GRAVITY_NONE, GRAVITY_FALL, GRAVITY_LOCK
+  };
+
+  /*
+    TETROMINO_SHAPES and TETROMINO_MASKS seen as flat int arrays, for gathers.
+  */
+  static_assert(sizeof(tetris_shape) % sizeof(std::int32_t) == 0,
+                "tetris_shape must be a whole number of ints");
+  constexpr int SHAPE_INTS = sizeof(tetris_shape) / sizeof(std::int32_t);
+  static_assert(sizeof(tetris_row) == sizeof(std::int32_t),
+                "the kernels treat a row as one 32-bit lane");
+
+  /*
+    The best instruction set this CPU has, and the one the kernels use.
+  */
+  static tetris_batch_isa cpu_isa()
+  {
+#ifdef TB_X86
+    __builtin_cpu_init();  // this runs before main
+    return __builtin_cpu_supports("avx2") ? TBI_AVX2 : TBI_SSE2;
+#else
+    return TBI_SCALAR;
+#endif
+  }
+  static tetris_batch_isa batch_isa = cpu_isa();
+
+  static bool have_avx2()
+  {
+    return batch_isa >= TBI_AVX2;
+  }
+
+  static bool have_sse2()
+  {
+    return batch_isa >= TBI_SSE2;
+  }
+
+  static tetris_color_row shift_colors(tetris_color_row value, int col)
+  {
+    return col >= 0 ? value << (BITS_PER_COLOR * col)
+                    : value >> (BITS_PER_COLOR * -col);
+  }
+
+  /*******************************************************************************
+
+                                 Construction
+
+  *******************************************************************************/
+
+  tetris_batch::tetris_batch(int n, int rows, int cols, std::uint64_t seed,
+                             tetris_randomizer randomizer)
+  {
+    int g;
+    if (n < 0 || !tg_valid_size(rows, cols))
+      throw std::invalid_argument("tetris_batch: size out of range");
+    this->n = n;
+    this->stride = (n + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+    this->rows = rows;
+    this->cols = cols;
+    full_row = (tetris_row(1) << this->cols) - 1;
+
+    board.assign(this->rows * stride, 0);
+    colors.assign(this->rows * stride, 0);
+    heights.assign(this->cols * stride, 0);
+    locked_rows.assign(stride, 0);
+    full_rows.assign(stride, 0);
+    typ.assign(stride, 0);
+    ori.assign(stride, 0);
+    row.assign(stride, 0);
+    col.assign(stride, 0);
+    next_typ.assign(stride, 0);
+    stored.assign(stride, tetris_block{-1, 0, {0, 0}});
+    ticks_till_gravity.assign(stride, GRAVITY_LEVEL[0]);
+    points.assign(stride, 0);
+    level.assign(stride, 0);
+    lines_remaining.assign(stride, LINES_PER_LEVEL);
+    running.assign(stride, 0);
+    gravity.assign(stride, GRAVITY_NONE);
+
+    // Game g draws the same pieces as tetris_game(rows, cols, seed + g).
+    pieces.clear();
+    pieces.reserve(n);
+    for (g = 0; g < n; g++) {
+      pieces.emplace_back(seed + g, randomizer);
+      running[g] = -1;
+      tb_new_falling(g);
+      tb_new_falling(g);
+    }
+  }
+
+  int tetris_batch::get_size() const{
+    return n;
+  }
+  int tetris_batch::get_rows() const{
+    return rows;
+  }
+  int tetris_batch::get_cols() const{
+    return cols;
+  }
+  bool tetris_batch::get_running(int g) const{
+    return running[g] != 0;
+  }
+  int tetris_batch::get_points(int g) const{
+    return points[g];
+  }
+  int tetris_batch::get_level(int g) const{
+    return level[g];
+  }
+  int tetris_batch::get_lines_remaining(int g) const{
+    return lines_remaining[g];
+  }
+  int tetris_batch::get_ticks_till_gravity(int g) const{
+    return ticks_till_gravity[g];
+  }
+  tetris_block tetris_batch::get_falling(int g) const{
+    return tb_falling(g);
+  }
+  int tetris_batch::get_preview(int g, int i) const{
+    return pieces[g].tp_peek(i);
+  }
+  tetris_block tetris_batch::get_next(int g) const{
+    return tetris_block{next_typ[g], 0, {0, cols/2 - 2}};
+  }
+  tetris_block tetris_batch::get_stored(int g) const{
+    return stored[g];
+  }
+
+  /*******************************************************************************
+
+                              Per-game functions
+
+  *******************************************************************************/
+
+  tetris_block tetris_batch::tb_falling(int g) const
+  {
+    return tetris_block{typ[g], ori[g], {row[g], col[g]}};
+  }
+
+  void tetris_batch::tb_set_falling(int g, tetris_block block)
+  {
+    typ[g] = block.typ;
+    ori[g] = block.ori;
+    row[g] = block.loc.row;
+    col[g] = block.loc.col;
+  }
+
+  /*
+    Return the cell at the given row and column of game g, falling block
+    included.
+  */
+  char tetris_batch::tb_get(int g, int r, int c) const
+  {
+    const tetris_shape &shape = TETROMINO_SHAPES[typ[g]][ori[g]];
+    int i = r - row[g] - shape.top;
+    if (0 <= i && i < shape.height) {
+      const tetris_mask &mask =
+        TETROMINO_MASKS[typ[g]][ori[g]][col[g] + MASK_COL_OFFSET];
+      if ((mask[i] >> c) & 1) {
+        return TYPE_TO_CELL(typ[g]);
+      }
+    }
+    return (colors[r * stride + g] >> (BITS_PER_COLOR * c)) & 0xF;
+  }
+
+  bool tetris_batch::tb_fits(int g, tetris_block block) const
+  {
+    const tetris_shape &shape = TETROMINO_SHAPES[block.typ][block.ori];
+    int top = block.loc.row + shape.top;
+    int i;
+    if (top < 0 || block.loc.row + shape.bottom >= rows ||
+        block.loc.col + shape.left < 0 || block.loc.col + shape.right >= cols) {
+      return false;
+    }
+    const tetris_mask &mask =
+      TETROMINO_MASKS[block.typ][block.ori][block.loc.col + MASK_COL_OFFSET];
+    for (i = 0; i < shape.height; i++) {
+      if (board[(top + i) * stride + g] & mask[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void tetris_batch::tb_put(int g, tetris_block block)
+  {
+    const tetris_shape &shape = TETROMINO_SHAPES[block.typ][block.ori];
+    const tetris_mask &mask =
+      TETROMINO_MASKS[block.typ][block.ori][block.loc.col + MASK_COL_OFFSET];
+    int i, r;
+    for (i = 0; i < shape.height; i++) {
+      tetris_color_row cells = shift_colors(shape.colors[i], block.loc.col);
+      r = block.loc.row + shape.top + i;
+      if (r < 0 || r >= rows)
+        continue;
+      board[r * stride + g] |= mask[i];
+      colors[r * stride + g] = (colors[r * stride + g] & ~(cells * 0xF)) |
+                               cells * TYPE_TO_CELL(block.typ);
+      locked_rows[g] |= tetris_row(1) << r;
+      for (tetris_row m = mask[i]; m; m &= m - 1) {
+        int c = __builtin_ctz(m);
+        heights[c * stride + g] = MAX(heights[c * stride + g], rows - r);
+      }
+    }
+  }
+
+  int tetris_batch::tb_drop_distance(int g, tetris_block block) const
+  {
+    const tetris_shape &shape = TETROMINO_SHAPES[block.typ][block.ori];
+    int j, c, space, dist = rows;
+    bool above = block.loc.row + shape.top >= 0 &&
+                 block.loc.col + shape.left >= 0 &&
+                 block.loc.col + shape.right < cols;
+    for (j = shape.left; above && j <= shape.right; j++) {
+      c = block.loc.col + j;
+      space = rows - heights[c * stride + g] - 1 -
+              (block.loc.row + shape.profile[j]);
+      if (space < 0)
+        above = false;
+      dist = MIN(dist, space);
+    }
+    if (above)
+      return dist;
+
+    dist = -1;
+    while (tb_fits(g, block)) {
+      block.loc.row++;
+      dist++;
+    }
+    return dist;
+  }
+
+  void tetris_batch::tb_new_falling(int g)
+  {
+    tb_set_falling(g, get_next(g));
+    next_typ[g] = pieces[g].tp_pop();
+  }
+
+  /*
+    tg_move, tg_rotate, tg_down and tg_hold for game g.
+  */
+  void tetris_batch::tb_handle_move(int g, tetris_move move)
+  {
+    tetris_block falling = tb_falling(g);
+    int i, direction = 1;
+    switch (move) {
+    case TM_LEFT:
+      direction = -1;
+      // fall through
+    case TM_RIGHT:
+      falling.loc.col += direction;
+      if (!tb_fits(g, falling))
+        return;
+      break;
+    case TM_DROP:
+      falling.loc.row += tb_drop_distance(g, falling);
+      tb_put(g, falling);
+      tb_new_falling(g);
+      return;
+    case TM_COUNTER:
+      direction = -1;
+      // fall through
+    case TM_CLOCK:
+      for (i = 0; i < NUM_ORIENTATIONS; i++) {
+        falling.ori = (falling.ori + direction + NUM_ORIENTATIONS) % NUM_ORIENTATIONS;
+        if (tb_fits(g, falling))
+          break;
+        falling.loc.col--;
+        if (tb_fits(g, falling))
+          break;
+        falling.loc.col += 2;
+        if (tb_fits(g, falling))
+          break;
+        falling.loc.col--;
+      }
+      break;
+    case TM_HOLD:
+      if (stored[g].typ == -1) {
+        stored[g].typ = falling.typ;
+        stored[g].ori = falling.ori;
+        tb_new_falling(g);
+        return;
+      }
+      {
+        tetris_block swapped = falling;
+        swapped.typ = stored[g].typ;
+        swapped.ori = stored[g].ori;
+        while (!tb_fits(g, swapped) &&
+               swapped.loc.row + TETROMINO_SHAPES[swapped.typ][swapped.ori].top > 0) {
+          swapped.loc.row--;
+        }
+        if (!tb_fits(g, swapped))
+          return;
+        stored[g].typ = falling.typ;
+        stored[g].ori = falling.ori;
+        falling = swapped;
+      }
+      break;
+    default:
+      return;
+    }
+    tb_set_falling(g, falling);
+  }
+
+  void tetris_batch::tb_update_heights(int g)
+  {
+    tetris_row seen = 0, found, b;
+    int r, c;
+    for (c = 0; c < cols; c++) {
+      heights[c * stride + g] = 0;
+    }
+    for (r = 0; r < rows && seen != full_row; r++) {
+      b = board[r * stride + g];
+      for (found = b & ~seen; found; found &= found - 1) {
+        heights[__builtin_ctz(found) * stride + g] = rows - r;
+      }
+      seen |= b;
+    }
+  }
+
+  /*
+    Remove the rows in full_rows[g], compacting the rest downward once.
+  */
+  int tetris_batch::tb_clear_lines(int g)
+  {
+    tetris_row full = full_rows[g];
+    int i, dst = 31 - __builtin_clz(full);
+    for (i = dst - 1; i >= 0; i--) {
+      if (!((full >> i) & 1)) {
+        board[dst * stride + g] = board[i * stride + g];
+        colors[dst * stride + g] = colors[i * stride + g];
+        dst--;
+      }
+    }
+    for (; dst >= 0; dst--) {
+      board[dst * stride + g] = 0;
+      colors[dst * stride + g] = 0;
+    }
+    tb_update_heights(g);
+    return __builtin_popcount(full);
+  }
+
+  void tetris_batch::tb_adjust_score(int g, int lines_cleared)
+  {
+    static std::array<int, 5> line_multiplier = {0, 40, 100, 300, 1200};
+    points[g] += line_multiplier[lines_cleared] * (level[g] + 1);
+    if (lines_cleared >= lines_remaining[g]) {
+      level[g] = MIN(MAX_LEVEL, level[g] + 1);
+      lines_cleared -= lines_remaining[g];
+      lines_remaining[g] = LINES_PER_LEVEL - lines_cleared;
+    } else {
+      lines_remaining[g] -= lines_cleared;
+    }
+  }
+
+  /*******************************************************************************
+
+                                   Kernels
+
+  *******************************************************************************/
+
+  /*
+    Count down gravity in every running game, and for those where it acts,
+    decide whether the falling block moves down or locks.
+  */
+#ifdef TB_X86
+  __attribute__((target("avx2")))
+  static void gravity_avx2(int stride, int rows, int cols,
+                           const tetris_row *board, const std::int32_t *running,
+                           std::int32_t *ticks, const std::int32_t *typ,
+                           const std::int32_t *ori, const std::int32_t *row,
+                           const std::int32_t *col, std::int32_t *gravity)
+  {
+    const int *shapes = reinterpret_cast<const int *>(&TETROMINO_SHAPES[0][0]);
+    const int *masks = reinterpret_cast<const int *>(&TETROMINO_MASKS[0][0][0][0]);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i vcols = _mm256_set1_epi32(cols);
+    const __m256i last_row = _mm256_set1_epi32(rows - 1);
+    const __m256i vstride = _mm256_set1_epi32(stride);
+    int g, i;
+
+    for (g = 0; g < stride; g += BATCH_LANES) {
+      __m256i run = _mm256_loadu_si256((const __m256i *) (running + g));
+      __m256i t = _mm256_loadu_si256((const __m256i *) (ticks + g));
+      t = _mm256_add_epi32(t, run);  // running lanes are -1
+      _mm256_storeu_si256((__m256i *) (ticks + g), t);
+      __m256i fire = _mm256_and_si256(run, _mm256_cmpgt_epi32(one, t));
+      if (_mm256_testz_si256(fire, fire)) {
+        _mm256_storeu_si256((__m256i *) (gravity + g), zero);
+        continue;
+      }
+
+      // Does the block fit one row down?
+      __m256i r = _mm256_add_epi32(
+        _mm256_loadu_si256((const __m256i *) (row + g)), one);
+      __m256i c = _mm256_loadu_si256((const __m256i *) (col + g));
+      __m256i shape = _mm256_add_epi32(
+        _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *) (typ + g)), 2),
+        _mm256_loadu_si256((const __m256i *) (ori + g)));
+      __m256i sidx = _mm256_mullo_epi32(shape, _mm256_set1_epi32(SHAPE_INTS));
+      __m256i top = _mm256_add_epi32(
+        r, _mm256_i32gather_epi32(shapes + offsetof(tetris_shape, top) / 4, sidx, 4));
+      __m256i bottom = _mm256_add_epi32(
+        r, _mm256_i32gather_epi32(shapes + offsetof(tetris_shape, bottom) / 4, sidx, 4));
+      __m256i left = _mm256_add_epi32(
+        c, _mm256_i32gather_epi32(shapes + offsetof(tetris_shape, left) / 4, sidx, 4));
+      __m256i right = _mm256_add_epi32(
+        c, _mm256_i32gather_epi32(shapes + offsetof(tetris_shape, right) / 4, sidx, 4));
+      __m256i inside = _mm256_andnot_si256(
+        _mm256_or_si256(
+          _mm256_or_si256(_mm256_cmpgt_epi32(zero, top),
+                          _mm256_cmpgt_epi32(bottom, last_row)),
+          _mm256_or_si256(_mm256_cmpgt_epi32(zero, left),
+                          _mm256_cmpgt_epi32(right, _mm256_sub_epi32(vcols, one)))),
+        fire);
+
+      __m256i midx = _mm256_slli_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(shape, _mm256_set1_epi32(MASK_COLS)),
+                         _mm256_add_epi32(c, _mm256_set1_epi32(MASK_COL_OFFSET))),
+        2);
+      __m256i hit = zero;
+      for (i = 0; i < TETRIS; i++) {
+        __m256i m = _mm256_mask_i32gather_epi32(
+          zero, masks, _mm256_add_epi32(midx, _mm256_set1_epi32(i)), inside, 4);
+        __m256i rr = _mm256_min_epi32(
+          _mm256_add_epi32(top, _mm256_set1_epi32(i)), last_row);
+        __m256i bidx = _mm256_add_epi32(_mm256_mullo_epi32(rr, vstride), lane);
+        __m256i b = _mm256_mask_i32gather_epi32(
+          zero, reinterpret_cast<const int *>(board + g), bidx, inside, 4);
+        hit = _mm256_or_si256(hit, _mm256_and_si256(m, b));
+      }
+      __m256i fits = _mm256_and_si256(_mm256_cmpeq_epi32(hit, zero), inside);
+      __m256i lock = _mm256_andnot_si256(fits, fire);
+      __m256i result = _mm256_or_si256(
+        _mm256_and_si256(fits, _mm256_set1_epi32(GRAVITY_FALL)),
+        _mm256_and_si256(lock, _mm256_set1_epi32(GRAVITY_LOCK)));
+      _mm256_storeu_si256((__m256i *) (gravity + g), result);
+    }
+  }
+#endif
+
+  void tetris_batch::tb_gravity_kernel()
+  {
+    int g;
+#ifdef TB_X86
+    if (have_avx2()) {
+      gravity_avx2(stride, rows, cols, board.data(), running.data(),
+                   ticks_till_gravity.data(), typ.data(), ori.data(), row.data(),
+                   col.data(), gravity.data());
+      return;
+    }
+#endif
+    for (g = 0; g < n; g++) {
+      gravity[g] = GRAVITY_NONE;
+      if (!running[g])
+        continue;
+      ticks_till_gravity[g]--;
+      if (ticks_till_gravity[g] <= 0) {
+        tetris_block below = tb_falling(g);
+        below.loc.row++;
+        gravity[g] = tb_fits(g, below) ? GRAVITY_FALL : GRAVITY_LOCK;
+      }
+    }
+  }
+
+  /*
+    Find the full rows among those each game locked a block into this tick,
+    leaving them in full_rows and resetting locked_rows.  Returns whether any
+    game has a row to clear.
+  */
+#ifdef TB_X86
+  __attribute__((target("avx2")))
+  static bool full_rows_avx2(int stride, int rows, tetris_row full_row,
+                             const tetris_row *board, tetris_row *locked_rows,
+                             tetris_row *full_rows)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vfull = _mm256_set1_epi32(full_row);
+    __m256i any = zero;
+    int g, r;
+    for (g = 0; g < stride; g += BATCH_LANES) {
+      __m256i locked = _mm256_loadu_si256((const __m256i *) (locked_rows + g));
+      __m256i full = zero;
+      if (!_mm256_testz_si256(locked, locked)) {
+        for (r = 0; r < rows; r++) {
+          __m256i b = _mm256_loadu_si256((const __m256i *) (board + r * stride + g));
+          full = _mm256_or_si256(full, _mm256_and_si256(
+            _mm256_cmpeq_epi32(b, vfull), _mm256_set1_epi32(1u << r)));
+        }
+        full = _mm256_and_si256(full, locked);
+        any = _mm256_or_si256(any, full);
+        _mm256_storeu_si256((__m256i *) (locked_rows + g), zero);
+      }
+      _mm256_storeu_si256((__m256i *) (full_rows + g), full);
+    }
+    return !_mm256_testz_si256(any, any);
+  }
+
+  static bool full_rows_sse2(int stride, int rows, tetris_row full_row,
+                             const tetris_row *board, tetris_row *locked_rows,
+                             tetris_row *full_rows)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vfull = _mm_set1_epi32(full_row);
+    __m128i any = zero;
+    int g, r;
+    for (g = 0; g < stride; g += 4) {
+      __m128i locked = _mm_loadu_si128((const __m128i *) (locked_rows + g));
+      __m128i full = zero;
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(locked, zero)) != 0xFFFF) {
+        for (r = 0; r < rows; r++) {
+          __m128i b = _mm_loadu_si128((const __m128i *) (board + r * stride + g));
+          full = _mm_or_si128(full, _mm_and_si128(
+            _mm_cmpeq_epi32(b, vfull), _mm_set1_epi32(1u << r)));
+        }
+        full = _mm_and_si128(full, locked);
+        any = _mm_or_si128(any, full);
+        _mm_storeu_si128((__m128i *) (locked_rows + g), zero);
+      }
+      _mm_storeu_si128((__m128i *) (full_rows + g), full);
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(any, zero)) != 0xFFFF;
+  }
+#endif
+
+  bool tetris_batch::tb_full_rows_kernel()
+  {
+    bool any = false;
+    int g, i;
+    tetris_row pending;
+#ifdef TB_X86
+    if (have_avx2())
+      return full_rows_avx2(stride, rows, full_row, board.data(),
+                            locked_rows.data(), full_rows.data());
+    if (have_sse2())
+      return full_rows_sse2(stride, rows, full_row, board.data(),
+                            locked_rows.data(), full_rows.data());
+#endif
+    for (g = 0; g < n; g++) {
+      pending = locked_rows[g];
+      locked_rows[g] = 0;
+      full_rows[g] = 0;
+      while (pending) {
+        i = __builtin_ctz(pending);
+        pending &= pending - 1;
+        if (board[i * stride + g] == full_row)
+          full_rows[g] |= tetris_row(1) << i;
+      }
+      any = any || full_rows[g];
+    }
+    return any;
+  }
+
+  /*
+    Stop every game with a locked cell in the top two rows, and return how many
+    games are still running.
+  */
+#ifdef TB_X86
+  __attribute__((target("avx2")))
+  static int game_over_avx2(int stride, const tetris_row *board,
+                            std::int32_t *running)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    int g, count = 0;
+    for (g = 0; g < stride; g += BATCH_LANES) {
+      __m256i top = _mm256_or_si256(
+        _mm256_loadu_si256((const __m256i *) (board + g)),
+        _mm256_loadu_si256((const __m256i *) (board + stride + g)));
+      __m256i run = _mm256_and_si256(
+        _mm256_loadu_si256((const __m256i *) (running + g)),
+        _mm256_cmpeq_epi32(top, zero));
+      _mm256_storeu_si256((__m256i *) (running + g), run);
+      count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(run)));
+    }
+    return count;
+  }
+
+  static int game_over_sse2(int stride, const tetris_row *board,
+                            std::int32_t *running)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    int g, count = 0;
+    for (g = 0; g < stride; g += 4) {
+      __m128i top = _mm_or_si128(
+        _mm_loadu_si128((const __m128i *) (board + g)),
+        _mm_loadu_si128((const __m128i *) (board + stride + g)));
+      __m128i run = _mm_and_si128(
+        _mm_loadu_si128((const __m128i *) (running + g)),
+        _mm_cmpeq_epi32(top, zero));
+      _mm_storeu_si128((__m128i *) (running + g), run);
+      count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(run)));
+    }
+    return count;
+  }
+#endif
+
+  int tetris_batch::tb_game_over_kernel()
+  {
+    int g, count = 0;
+#ifdef TB_X86
+    if (have_avx2())
+      return game_over_avx2(stride, board.data(), running.data());
+    if (have_sse2())
+      return game_over_sse2(stride, board.data(), running.data());
+#endif
+    for (g = 0; g < n; g++) {
+      if (board[g] | board[stride + g])
+        running[g] = 0;
+      count += running[g] != 0;
+    }
+    return count;
+  }
+
+  /*******************************************************************************
+
+                              Main Public Functions
+
+  *******************************************************************************/
+
+  /*
+    Return a bit for each of the games g..g+7 that has more to do this tick than
+    count down gravity: it is running, and gravity acts or there is a move.
+  */
+#ifdef TB_X86
+  __attribute__((target("avx2")))
+  static unsigned active_avx2(const std::int32_t *running,
+                              const std::int32_t *gravity,
+                              const tetris_move *moves)
+  {
+    static_assert(sizeof(tetris_move) == sizeof(std::int32_t),
+                  "moves are read as 32-bit lanes");
+    __m256i idle = _mm256_and_si256(
+      _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *) gravity),
+                         _mm256_set1_epi32(GRAVITY_NONE)),
+      _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *) moves),
+                         _mm256_set1_epi32(TM_NONE)));
+    __m256i active = _mm256_andnot_si256(
+      idle, _mm256_loadu_si256((const __m256i *) running));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(active));
+  }
+#endif
+
+  unsigned tetris_batch::tb_active_lanes(const tetris_move *moves, int g) const
+  {
+    unsigned active = 0;
+    int l;
+#ifdef TB_X86
+    // moves has only n entries, so the last partial block is done by hand.
+    if (g + BATCH_LANES <= n && have_avx2())
+      return active_avx2(running.data() + g, gravity.data() + g, moves + g);
+#endif
+    for (l = 0; l < BATCH_LANES && g + l < n; l++) {
+      if (running[g + l] &&
+          (gravity[g + l] != GRAVITY_NONE || moves[g + l] != TM_NONE))
+        active |= 1u << l;
+    }
+    return active;
+  }
+
+  /*
+    The rest of game g's gravity tick, then its move.
+  */
+  void tetris_batch::tb_update(int g, tetris_move move)
+  {
+    if (gravity[g] == GRAVITY_FALL) {
+      row[g]++;
+      ticks_till_gravity[g] = GRAVITY_LEVEL[level[g]];
+    } else if (gravity[g] == GRAVITY_LOCK) {
+      tb_put(g, tb_falling(g));
+      tb_new_falling(g);
+    }
+    tb_handle_move(g, move);
+  }
+
+  /*
+    One tg_tick for every running game: gravity, input, line clears, score and
+    the game-over test, in that order.
+  */
+  int tetris_batch::tb_step(const tetris_move *moves)
+  {
+    unsigned active;
+    int g;
+    tb_gravity_kernel();
+
+    // Most ticks of most games have nothing to do after the countdown.
+    for (g = 0; g < n; g += BATCH_LANES) {
+      for (active = tb_active_lanes(moves, g); active; active &= active - 1) {
+        int l = __builtin_ctz(active);
+        tb_update(g + l, moves[g + l]);
+      }
+    }
+
+    if (tb_full_rows_kernel()) {
+      for (g = 0; g < n; g++) {
+        if (full_rows[g])
+          tb_adjust_score(g, tb_clear_lines(g));
+      }
+    }
+
+    return tb_game_over_kernel();
+  }
+
+  tetris_batch_isa tetris_batch::tb_set_isa(tetris_batch_isa isa)
+  {
+    batch_isa = MIN(isa, cpu_isa());
+    return batch_isa;
+  }
+
+  tetris_batch_isa tetris_batch::get_isa()
+  {
+    return batch_isa;
+  }
+}
@@ -0,0 +1,138 @@
+/***************************************************************************//**
+
+  @file         tetris_batch.hpp
+
+  @brief        Many tetris games stepped in lockstep.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_game.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace tetris{
+
+  /*
+    Number of games handled by one vector operation (AVX2 lanes of 32 bits).
+    Every per-game array is padded to a multiple of this.
+  */
+  constexpr unsigned short BATCH_LANES = 8;
+
+  /*
+    Instruction sets the kernels can use, each including the ones before.
+  */
+  enum tetris_batch_isa {
+    TBI_SCALAR, TBI_SSE2, TBI_AVX2
+  };
+
+  /*
+    A batch of games kept as structure-of-arrays.  Row r of every game is stored
+    contiguously (board[r * stride + g]), and the falling block, counters and
+    flags are parallel arrays indexed by game.  Each call to tb_step advances
+    every running game by exactly one tg_tick.  Gravity, the line-full scan and
+    the game-over test run as SIMD kernels over all games (AVX2 or SSE2,
+    whichever the CPU has, or plain loops elsewhere); moves and line clears are
+    handled game by game.
+  */
+  class tetris_batch {
+
+    private:
+      int n;
+      int stride;
+      int rows;
+      int cols;
+      tetris_row full_row;
+      /*
+        Boards, one row of every game after another, laid out like tetris_game's
+        board and colors.  heights is indexed [col * stride + g].
+      */
+      std::vector<tetris_row> board;
+      std::vector<tetris_color_row> colors;
+      std::vector<int> heights;
+      std::vector<tetris_row> locked_rows;
+      std::vector<tetris_row> full_rows;
+      /*
+        The falling block of each game.
+      */
+      std::vector<std::int32_t> typ;
+      std::vector<std::int32_t> ori;
+      std::vector<std::int32_t> row;
+      std::vector<std::int32_t> col;
+      std::vector<std::int32_t> next_typ;
+      std::vector<tetris_block> stored;
+      std::vector<tetris_pieces> pieces;
+      /*
+        Scoring and timing.
+      */
+      std::vector<std::int32_t> ticks_till_gravity;
+      std::vector<std::int32_t> points;
+      std::vector<std::int32_t> level;
+      std::vector<std::int32_t> lines_remaining;
+      /*
+        running[g] is all ones while game g is still going.  gravity[g] is what
+        gravity does to game g this tick (see GRAVITY_* in tetris_batch.cpp).
+      */
+      std::vector<std::int32_t> running;
+      std::vector<std::int32_t> gravity;
+
+      tetris_block tb_falling(int g) const;
+      void tb_set_falling(int g, tetris_block block);
+      bool tb_fits(int g, tetris_block block) const;
+      void tb_put(int g, tetris_block block);
+      int tb_drop_distance(int g, tetris_block block) const;
+      void tb_new_falling(int g);
+      void tb_handle_move(int g, tetris_move move);
+      void tb_update_heights(int g);
+      int tb_clear_lines(int g);
+      void tb_adjust_score(int g, int lines_cleared);
+      void tb_update(int g, tetris_move move);
+
+      // Kernels over every game.
+      void tb_gravity_kernel();
+      unsigned tb_active_lanes(const tetris_move *moves, int g) const;
+      bool tb_full_rows_kernel();
+      int tb_game_over_kernel();
+
+    public:
+      /*
+        Game g gets seed + g, so it plays the same pieces as a tetris_game
+        created with that seed.  Throws std::invalid_argument for a negative
+        n or a size that isn't tg_valid_size.
+      */
+      tetris_batch(int n, int rows, int cols, std::uint64_t seed,
+                   tetris_randomizer randomizer = TR_UNIFORM);
+
+      int get_size() const;
+      int get_rows() const;
+      int get_cols() const;
+      bool get_running(int g) const;
+      int get_points(int g) const;
+      int get_level(int g) const;
+      int get_lines_remaining(int g) const;
+      int get_ticks_till_gravity(int g) const;
+      tetris_block get_falling(int g) const;
+      tetris_block get_next(int g) const;
+      tetris_block get_stored(int g) const;
+      int get_preview(int g, int i) const;
+
+      char tb_get(int g, int row, int col) const;
+      /*
+        Tick every running game once, game g receiving moves[g].  Returns the
+        number of games still running.
+      */
+      int tb_step(const tetris_move *moves);
+
+      /*
+        Use kernels for at most isa, for every batch in the process, so each
+        path can be checked against tetris_game.  Returns the instruction set
+        now in use, which is lower than isa if the CPU lacks it.  The default
+        is the best the CPU has.
+      */
+      static tetris_batch_isa tb_set_isa(tetris_batch_isa isa);
+      static tetris_batch_isa get_isa();
+  };
+}
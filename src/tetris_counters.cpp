@@ -0,0 +1,160 @@
+/***************************************************************************//**
+
+  @file         tetris_counters.cpp
+
+  @brief        Hardware performance counters around a stretch of work.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_counters.hpp"
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tetris{
+
+  void tetris_counter_values::tcv_add(const tetris_counter_values &other)
+  {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      if (other.valid[i]) {
+        counts[i] += other.counts[i];
+        valid[i] = true;
+      }
+    }
+  }
+
+  bool tetris_counter_values::tcv_any() const
+  {
+    for (bool v : valid) {
+      if (v)
+        return true;
+    }
+    return false;
+  }
+
+  tetris_perf_counters::tetris_perf_counters()
+  {
+    fds.fill(-1);
+  }
+
+  tetris_perf_counters::~tetris_perf_counters()
+  {
+    tpc_close();
+  }
+
+#ifdef __linux__
+
+  /*
+    The perf_event type and config of each counter.
+  */
+  static const std::uint32_t COUNTER_TYPES[NUM_COUNTERS] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+    PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+  };
+  static const std::uint64_t COUNTER_CONFIGS[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+      PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_CACHE_MISSES
+  };
+
+  bool tetris_perf_counters::tpc_open()
+  {
+    struct perf_event_attr attr;
+    bool any = false;
+    tpc_close();
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = COUNTER_TYPES[i];
+      attr.config = COUNTER_CONFIGS[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                       PERF_FLAG_FD_CLOEXEC);
+      any = any || fds[i] >= 0;
+    }
+    return any;
+  }
+
+  void tetris_perf_counters::tpc_close()
+  {
+    for (int &fd : fds) {
+      if (fd >= 0)
+        close(fd);
+      fd = -1;
+    }
+  }
+
+  void tetris_perf_counters::tpc_start()
+  {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  void tetris_perf_counters::tpc_stop()
+  {
+    for (int fd : fds) {
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+
+  tetris_counter_values tetris_perf_counters::tpc_read() const
+  {
+    tetris_counter_values values;
+    // The count, then the time enabled and the time actually counting.
+    std::uint64_t data[3];
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data) ||
+          data[2] == 0)
+        continue;
+      values.counts[i] = (double) data[0] * data[1] / data[2];
+      values.valid[i] = true;
+    }
+    return values;
+  }
+
+#else
+
+  bool tetris_perf_counters::tpc_open()
+  {
+    return false;
+  }
+
+  void tetris_perf_counters::tpc_close()
+  {
+  }
+
+  void tetris_perf_counters::tpc_start()
+  {
+  }
+
+  void tetris_perf_counters::tpc_stop()
+  {
+  }
+
+  tetris_counter_values tetris_perf_counters::tpc_read() const
+  {
+    return tetris_counter_values();
+  }
+
+#endif
+}
@@ -0,0 +1,72 @@
+/***************************************************************************//**
+
+  @file         tetris_counters.hpp
+
+  @brief        Hardware performance counters around a stretch of work.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include <array>
+
+namespace tetris{
+
+  enum tetris_counter {
+    TPC_CYCLES, TPC_INSTRUCTIONS, TPC_BRANCH_MISSES, TPC_L1D_MISSES,
+    TPC_LLC_MISSES, NUM_COUNTERS
+  };
+
+  constexpr const char *COUNTER_NAMES[NUM_COUNTERS] = {
+    "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"
+  };
+
+  /*
+    Event counts.  valid[i] is false for an event that wasn't counted, because
+    the machine has no such counter or the kernel won't hand it out.
+  */
+  struct tetris_counter_values {
+    std::array<double, NUM_COUNTERS> counts{};
+    std::array<bool, NUM_COUNTERS> valid{};
+
+    /*
+      Add in the counts of other, from another thread, say.
+    */
+    void tcv_add(const tetris_counter_values &other);
+    bool tcv_any() const;
+  };
+
+  /*
+    Counts cycles, instructions, branch misses and L1 data and last level cache
+    misses for the thread that opens it, in user space only, with Linux's
+    perf_event_open.  Each counter is opened on its own and may be missing:
+    everything still works, and reads as not valid, where a counter (or
+    perf_event_open, or Linux) isn't there, or perf_event_paranoid forbids it.
+    Counters the kernel has to multiplex are scaled up to the whole time.
+  */
+  class tetris_perf_counters {
+
+    private:
+      std::array<int, NUM_COUNTERS> fds;
+
+    public:
+      tetris_perf_counters();
+      ~tetris_perf_counters();
+      tetris_perf_counters(const tetris_perf_counters &) = delete;
+      tetris_perf_counters &operator=(const tetris_perf_counters &) = delete;
+
+      /*
+        Open the counters for this thread, stopped.  False if none would open.
+      */
+      bool tpc_open();
+      void tpc_close();
+      /*
+        Zero the counters and start counting.
+      */
+      void tpc_start();
+      void tpc_stop();
+      tetris_counter_values tpc_read() const;
+  };
+}
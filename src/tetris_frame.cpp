@@ -0,0 +1,96 @@
+/***************************************************************************//**
+
+  @file         tetris_frame.cpp
+
+  @brief        Snapshots of a game for drawing, and a buffer to hand them over.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_frame.hpp"
+#include "tetris_location.hpp"
+
+namespace tetris{
+
+  static_assert(TC_CELLZ < CELL_GHOST, "a ghost bit is free in every cell");
+
+  /*
+    Set the cell at col of a row of frame cells.
+  */
+  static void set_cell(tetris_color_row &row, int col, tetris_color_row cell)
+  {
+    int shift = BITS_PER_COLOR * col;
+    row = (row & ~(tetris_color_row(0xF) << shift)) | (cell << shift);
+  }
+
+  void tetris_frame::tf_capture(const tetris_game &game, bool running,
+                                std::uint64_t inputs)
+  {
+    int i;
+    tetris_block ghost = game.tg_ghost();
+    tetris_location c;
+
+    rows = game.get_rows();
+    cols = game.get_cols();
+    falling = game.get_falling();
+    next = game.get_next();
+    stored = game.get_stored();
+    points = game.get_points();
+    level = game.get_level();
+    lines_remaining = game.get_lines_remaining();
+    this->inputs = inputs;
+    this->running = running;
+
+    // The locked cells, then the ghost wherever they're empty, then the falling
+    // block over both.
+    for (i = 0; i < rows; i++) {
+      cells[i] = game.get_color_row(i);
+    }
+    for (i = 0; i < TETRIS; i++) {
+      c = TETROMINOS[ghost.typ][ghost.ori][i];
+      c.row += ghost.loc.row;
+      c.col += ghost.loc.col;
+      if (0 <= c.row && c.row < rows &&
+          TC_IS_EMPTY((cells[c.row] >> (BITS_PER_COLOR * c.col)) & 0xF))
+        set_cell(cells[c.row], c.col, CELL_GHOST | TYPE_TO_CELL(ghost.typ));
+    }
+    for (i = 0; i < TETRIS; i++) {
+      c = TETROMINOS[falling.typ][falling.ori][i];
+      c.row += falling.loc.row;
+      c.col += falling.loc.col;
+      if (0 <= c.row && c.row < rows)
+        set_cell(cells[c.row], c.col, TYPE_TO_CELL(falling.typ));
+    }
+  }
+
+  tetris_frame_buffer::tetris_frame_buffer()
+    : frames(), middle(1), back(0), front(2)
+  {
+  }
+
+  tetris_frame &tetris_frame_buffer::get_back()
+  {
+    return frames[back];
+  }
+
+  void tetris_frame_buffer::tfb_publish()
+  {
+    // Release the writes to the back frame along with it; acquire the middle
+    // frame's, which the reader may have just handed back.
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+  }
+
+  bool tetris_frame_buffer::tfb_update()
+  {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+    return true;
+  }
+
+  const tetris_frame &tetris_frame_buffer::get_front() const
+  {
+    return frames[front];
+  }
+}
@@ -0,0 +1,100 @@
+/***************************************************************************//**
+
+  @file         tetris_frame.hpp
+
+  @brief        Snapshots of a game for drawing, and a buffer to hand them over.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_game.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace tetris{
+
+  /*
+    A frame cell with this bit set shows the ghost of that cell's colour.
+  */
+  constexpr char CELL_GHOST = 8;
+
+  /*
+    Everything needed to draw a game at one moment.  The board is laid out as
+    the game's colour rows (BITS_PER_COLOR a cell), with the ghost of the
+    falling block in the empty cells it would land on and the falling block
+    over both, so drawing a frame is a matter of copying cells out of it.
+  */
+  struct tetris_frame {
+    int rows;
+    int cols;
+    std::array<tetris_color_row, MAX_ROWS> cells;
+    tetris_block falling;
+    tetris_block next;
+    tetris_block stored;
+    int points;
+    int level;
+    int lines_remaining;
+    /*
+      Moves from the player played so far, so the screen can tell which keys
+      a frame shows the effect of.
+    */
+    std::uint64_t inputs;
+    /*
+      False in the last frame of a game, once it is over or has been quit.
+    */
+    bool running;
+
+    void tf_capture(const tetris_game &game, bool running,
+                    std::uint64_t inputs);
+  };
+
+  /*
+    Hands frames from one thread to another without either one waiting.  Of the
+    three frames, the writer fills one, the reader draws one, and the third
+    holds the newest finished frame.  tfb_publish swaps the filled frame into
+    the middle and tfb_update swaps it out again, so the reader always gets the
+    latest frame and frames it was too slow for are dropped.  One writer and
+    one reader only.
+  */
+  class tetris_frame_buffer {
+
+    private:
+      static constexpr unsigned FRESH = 4;
+
+      std::array<tetris_frame, 3> frames;
+      /*
+        Index of the middle frame, with FRESH set if it was published since the
+        reader last took it.
+      */
+      alignas(64) std::atomic<unsigned> middle;
+      alignas(64) unsigned back;
+      alignas(64) unsigned front;
+
+    public:
+      tetris_frame_buffer();
+      tetris_frame_buffer(const tetris_frame_buffer &) = delete;
+      tetris_frame_buffer &operator=(const tetris_frame_buffer &) = delete;
+
+      /*
+        The frame for the writer to fill.
+      */
+      tetris_frame &get_back();
+      /*
+        Make the back frame the newest, and start on another.
+      */
+      void tfb_publish();
+      /*
+        Take the newest frame if one was published since the last call.  Returns
+        whether get_front changed.
+      */
+      bool tfb_update();
+      /*
+        The frame the reader took last.
+      */
+      const tetris_frame &get_front() const;
+  };
+}
@@ -12,16 +12,17 @@
                 BSD License.  See LICENSE.txt for details.
 
 *******************************************************************************/
-#include "tetris_game.hpp"  
-#include <iostream>
+#include "tetris_game.hpp"
+#include "tetris_snapshot.hpp"
+#include "tetris_trace.hpp"
 #include <array>
+#include <stdexcept>
 
 namespace tetris{
 
   #define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
   #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
 
-  // TODO: add the file handle functions again
   /*******************************************************************************
 
                                 Array Definitions
@@ -64,22 +65,54 @@ namespace tetris{
     return this->stored;
   }
 
+  std::uint64_t tetris_game::get_seed() const{
+    return this->seed;
+  }
+  tetris_randomizer tetris_game::get_randomizer() const{
+    return pieces.get_randomizer();
+  }
+  int tetris_game::get_preview(int i) const{
+    return pieces.tp_peek(i);
+  }
+
   int tetris_game::get_ticks_till_gravity() const{
     return this->ticks_till_gravity;
   }
   int tetris_game::get_lines_remaining() const{
     return this->lines_remaining;
   }
+  int tetris_game::get_height(int col) const{
+    return this->heights[col];
+  }
+  tetris_row tetris_game::get_row(int r) const{
+    return this->board[r];
+  }
+  tetris_color_row tetris_game::get_color_row(int r) const{
+    return this->colors[r];
+  }
+  std::uint64_t tetris_game::get_hash() const{
+    return this->hash;
+  }
 
 
 
 
   /*
-    Return the block at the given row and column.
+    Return the block at the given row and column.  The board only holds locked
+    cells, so the falling block is drawn over it here.
   */
   char tetris_game::tg_get (int row, int column) const
   {
-    return board[this->cols * row + column];
+    const tetris_shape &shape = TETROMINO_SHAPES[falling.typ][falling.ori];
+    int i = row - falling.loc.row - shape.top;
+    if (0 <= i && i < shape.height) {
+      const tetris_mask &mask =
+        TETROMINO_MASKS[falling.typ][falling.ori][falling.loc.col + MASK_COL_OFFSET];
+      if ((mask[i] >> column) & 1) {
+        return TYPE_TO_CELL(falling.typ);
+      }
+    }
+    return (colors[row] >> (BITS_PER_COLOR * column)) & 0xF;
   }
 
   /*
@@ -87,7 +120,17 @@ namespace tetris{
   */
   void tetris_game::tg_set(int row, int column, char value)
   {
-    board[this->cols * row + column] = value;
+    int shift = BITS_PER_COLOR * column;
+    colors[row] &= ~(tetris_color_row(0xF) << shift);
+    colors[row] |= tetris_color_row(value) << shift;
+    if (TC_IS_FILLED(value) != ((board[row] >> column) & 1)) {
+      hash ^= ZOBRIST[row][column];
+    }
+    if (TC_IS_FILLED(value)) {
+      board[row] |= tetris_row(1) << column;
+    } else {
+      board[row] &= ~(tetris_row(1) << column);
+    }
   }
 
   /*
@@ -99,27 +142,50 @@ namespace tetris{
   }
 
   /*
-    Place a block onto the board.
+    XOR of the Zobrist keys of the given cells of row r.
   */
-  void tetris_game::tg_put(tetris_block block)
+  static std::uint64_t row_hash(int r, tetris_row cells)
   {
-    int i;
-    for (i = 0; i < TETRIS; i++) {
-      tetris_location cell = TETROMINOS[block.typ][block.ori][i];
-      tg_set(block.loc.row + cell.row, block.loc.col + cell.col,
-            TYPE_TO_CELL(block.typ));
+    std::uint64_t h = 0;
+    for (; cells; cells &= cells - 1) {
+      h ^= ZOBRIST[r][__builtin_ctz(cells)];
     }
+    return h;
   }
 
   /*
-    Clear a block out of the board.
+    Shift a row of colour nibbles so that column 0 lands on the given column.
   */
-  void tetris_game::tg_remove(tetris_block block)
+  static tetris_color_row shift_colors(tetris_color_row value, int col)
   {
-    int i;
-    for (i = 0; i < TETRIS; i++) {
-      tetris_location cell = TETROMINOS[block.typ][block.ori][i];
-      tg_set(block.loc.row + cell.row, block.loc.col + cell.col, TC_EMPTY);
+    return col >= 0 ? value << (BITS_PER_COLOR * col)
+                    : value >> (BITS_PER_COLOR * -col);
+  }
+
+  /*
+    Place a block onto the board.
+  */
+  void tetris_game::tg_put(tetris_block block)
+  {
+    const tetris_shape &shape = TETROMINO_SHAPES[block.typ][block.ori];
+    const tetris_mask &mask =
+      TETROMINO_MASKS[block.typ][block.ori][block.loc.col + MASK_COL_OFFSET];
+    int i, r;
+    for (i = 0; i < shape.height; i++) {
+      tetris_color_row cells = shift_colors(shape.colors[i], block.loc.col);
+      r = block.loc.row + shape.top + i;
+      // A block that locks without fitting (only when the game is lost) can
+      // hang off the top of the board.
+      if (r < 0 || r >= rows)
+        continue;
+      hash ^= row_hash(r, mask[i] & ~board[r]);
+      board[r] |= mask[i];
+      locked_rows |= tetris_row(1) << r;
+      for (tetris_row m = mask[i]; m; m &= m - 1) {
+        int c = __builtin_ctz(m);
+        heights[c] = MAX(heights[c], rows - r);
+      }
+      colors[r] = (colors[r] & ~(cells * 0xF)) | cells * TYPE_TO_CELL(block.typ);
     }
   }
 
@@ -128,12 +194,17 @@ namespace tetris{
   */
   bool tetris_game::tg_fits (tetris_block block) const
   {
-    int i, r, c;
-    for (i = 0; i < TETRIS; i++) {
-      tetris_location cell = TETROMINOS[block.typ][block.ori][i];
-      r = block.loc.row + cell.row;
-      c = block.loc.col + cell.col;
-      if (!tg_check(r, c) || TC_IS_FILLED(tg_get(r, c))) {
+    const tetris_shape &shape = TETROMINO_SHAPES[block.typ][block.ori];
+    int top = block.loc.row + shape.top;
+    int i;
+    if (top < 0 || block.loc.row + shape.bottom >= rows ||
+        block.loc.col + shape.left < 0 || block.loc.col + shape.right >= cols) {
+      return false;
+    }
+    const tetris_mask &mask =
+      TETROMINO_MASKS[block.typ][block.ori][block.loc.col + MASK_COL_OFFSET];
+    for (i = 0; i < shape.height; i++) {
+      if (board[top + i] & mask[i]) {
         return false;
       }
     }
@@ -141,24 +212,65 @@ namespace tetris{
   }
 
   /*
-    Return a random tetromino type.
+    Return how many rows the block can fall before it lands.  When the block is
+    above the stack in every column it covers, this comes straight from the
+    column heights; otherwise (tucked under an overhang, or not fitting at all)
+    it steps down one row at a time like the original drop did.  A block that
+    doesn't fit where it is gets -1.
+  */
+  int tetris_game::tg_drop_distance(tetris_block block) const
+  {
+    const tetris_shape &shape = TETROMINO_SHAPES[block.typ][block.ori];
+    int j, c, space, dist = rows;
+    bool above = block.loc.row + shape.top >= 0 &&
+                 block.loc.col + shape.left >= 0 &&
+                 block.loc.col + shape.right < cols;
+    for (j = shape.left; above && j <= shape.right; j++) {
+      c = block.loc.col + j;
+      // Empty rows between the lowest cell in this column and the stack.
+      space = rows - heights[c] - 1 - (block.loc.row + shape.profile[j]);
+      if (space < 0)
+        above = false;
+      dist = MIN(dist, space);
+    }
+    if (above)
+      return dist;
+
+    dist = -1;
+    while (tg_fits(block)) {
+      block.loc.row++;
+      dist++;
+    }
+    return dist;
+  }
+
+  /*
+    Return a block of the given type where new blocks appear.
   */
-  int tetris_game::random_tetromino() {
-    return rand() % NUM_TETROMINOS;
+  tetris_block tetris_game::tg_spawn(int typ) const
+  {
+    return tetris_block{typ, 0, {0, cols/2 - 2}};
   }
 
   /*
-    Create a new falling block and populate the next falling block with a random
-    one.
+    Return where the falling block would land if it were dropped now.
+  */
+  tetris_block tetris_game::tg_ghost() const
+  {
+    tetris_block ghost = falling;
+    ghost.loc.row += tg_drop_distance(falling);
+    return ghost;
+  }
+
+  /*
+    Create a new falling block and populate the next falling block from the
+    piece queue.
   */
   void tetris_game::tg_new_falling()
   {
     // Put in a new falling tetromino.
     falling = next;
-    next.typ = tetris_game::random_tetromino();
-    next.ori = 0;
-    next.loc.row = 0;
-    next.loc.col = cols/2 - 2;
+    next = tg_spawn(pieces.tp_pop());
   }
 
   /*******************************************************************************
@@ -174,7 +286,6 @@ namespace tetris{
   {
     ticks_till_gravity--;
     if (ticks_till_gravity <= 0) {
-      tg_remove(falling);
       falling.loc.row++;
       if (tg_fits(falling)) {
         ticks_till_gravity = GRAVITY_LEVEL[level];
@@ -184,7 +295,6 @@ namespace tetris{
 
         tg_new_falling();
       }
-      tg_put(falling);
     }
   }
 
@@ -194,12 +304,10 @@ namespace tetris{
   */
   void tetris_game::tg_move(int direction)
   {
-    tg_remove(falling);
     falling.loc.col += direction;
     if (!tg_fits(falling)) {
       falling.loc.col -= direction;
     }
-    tg_put(falling);
   }
 
   /*
@@ -207,46 +315,49 @@ namespace tetris{
   */
   void tetris_game::tg_down()
   {
-    tg_remove(falling);
-    while (tg_fits(falling)) {
-      falling.loc.row++;
-    }
-    falling.loc.row--;
+    falling.loc.row += tg_drop_distance(falling);
     tg_put(falling);
     tg_new_falling();
   }
 
   /*
-    Rotate the falling block in either direction (+/-1).
+    Return where a block ends up when rotated in either direction (+/-1).
   */
-  void tetris_game::tg_rotate(int direction)
+  tetris_block tetris_game::tg_rotated(tetris_block block, int direction) const
   {
-    tg_remove(falling);
-
-    while (true) {
-      falling.ori = (falling.ori + direction) % NUM_ORIENTATIONS;
+    int i;
+    for (i = 0; i < NUM_ORIENTATIONS; i++) {
+      block.ori = (block.ori + direction + NUM_ORIENTATIONS) % NUM_ORIENTATIONS;
 
       // If the new orientation fits, we're done.
-      if (tg_fits(falling))
+      if (tg_fits(block))
         break;
 
       // Otherwise, try moving left to make it fit.
-      falling.loc.col--;
-      if (tg_fits(falling))
+      block.loc.col--;
+      if (tg_fits(block))
         break;
 
       // Finally, try moving right to make it fit.
-      falling.loc.col += 2;
-      if (tg_fits(falling))
+      block.loc.col += 2;
+      if (tg_fits(block))
         break;
 
       // Put it back in its original location and try the next orientation.
-      falling.loc.col--;
-      // Worst case, we come back to the original orientation and it fits, so this
-      // loop will terminate.
+      block.loc.col--;
+      // Worst case, we come back to the original orientation.  That normally
+      // fits, but a freshly spawned block can overlap the locked cells at the
+      // end of a game, so don't go around more than once.
     }
+    return block;
+  }
 
-    tg_put(falling);
+  /*
+    Rotate the falling block in either direction (+/-1).
+  */
+  void tetris_game::tg_rotate(int direction)
+  {
+    falling = tg_rotated(falling, direction);
   }
 
   /*
@@ -254,21 +365,27 @@ namespace tetris{
   */
   void tetris_game::tg_hold()
   {
-    tg_remove(falling);
+    // Only the type and orientation are kept; the hold has no position.
     if (stored.typ == -1) {
-      stored = falling;
+      stored.typ = falling.typ;
+      stored.ori = falling.ori;
       tg_new_falling();
     } else {
-      int typ = falling.typ, ori = falling.ori;
-      falling.typ = stored.typ;
-      falling.ori = stored.ori;
-      stored.typ = typ;
-      stored.ori = ori;
-      while (!tg_fits(falling)) {
-        falling.loc.row--;
+      tetris_block swapped = falling;
+      swapped.typ = stored.typ;
+      swapped.ori = stored.ori;
+      // Move up until it fits.  Against a wall, or at the end of a game, there
+      // may be nowhere above for it to go, and then the hold does nothing.
+      while (!tg_fits(swapped) &&
+             swapped.loc.row + TETROMINO_SHAPES[swapped.typ][swapped.ori].top > 0) {
+        swapped.loc.row--;
+      }
+      if (tg_fits(swapped)) {
+        stored.typ = falling.typ;
+        stored.ori = falling.ori;
+        falling = swapped;
       }
     }
-    tg_put(falling);
   }
 
   /*
@@ -306,47 +423,62 @@ namespace tetris{
   */
   bool tetris_game::tg_line_full (int i) const
   {
-    int j;
-    for (j = 0; j < cols; j++) {
-      if (TC_IS_EMPTY(tg_get(i, j)))
-        return false;
-    }
-    return true;
+    return board[i] == full_row;
   }
 
   /*
-    Shift every row above r down one.
+    Recompute every column height from the board, top row first.
   */
-  void tetris_game::tg_shift_lines(int r)
+  void tetris_game::tg_update_heights()
   {
-    int i, j;
-    for (i = r-1; i >= 0; i--) {
-      for (j = 0; j < cols; j++) {
-        tg_set(i+1, j, tg_get(i, j));
-        tg_set(i, j, TC_EMPTY);
+    tetris_row seen = 0, found;
+    int r;
+    heights.fill(0);
+    for (r = 0; r < rows && seen != full_row; r++) {
+      for (found = board[r] & ~seen; found; found &= found - 1) {
+        heights[__builtin_ctz(found)] = rows - r;
       }
+      seen |= board[r];
     }
   }
 
   /*
     Find rows that are filled, remove them, shift, and return the number of
-    cleared rows.
+    cleared rows.  Only rows that the last locked block was put into can have
+    become full, so those are the only ones checked.
   */
   int tetris_game::tg_check_lines()
   {
-    int i, nlines = 0;
-    tg_remove(falling); // don't want to mess up falling block
-
-    for (i = rows-1; i >= 0; i--) {
-      if (tg_line_full(i)) {
-        tg_shift_lines(i);
-        i++; // do this line over again since they're shifted
-        nlines++;
+    tetris_row pending = locked_rows, full = 0;
+    int i, dst;
+    locked_rows = 0;
+    while (pending) {
+      i = __builtin_ctz(pending);
+      pending &= pending - 1;
+      if (tg_line_full(i))
+        full |= tetris_row(1) << i;
+    }
+    if (!full)
+      return 0;
+
+    // Compact from the lowest full row upward, copying each surviving row
+    // exactly once.  Rows below the lowest full row don't move.
+    dst = 31 - __builtin_clz(full);
+    for (i = dst - 1; i >= 0; i--) {
+      if (!((full >> i) & 1)) {
+        hash ^= row_hash(dst, board[dst]) ^ row_hash(dst, board[i]);
+        board[dst] = board[i];
+        colors[dst] = colors[i];
+        dst--;
       }
     }
-
-    tg_put(falling); // replace
-    return nlines;
+    for (; dst >= 0; dst--) {
+      hash ^= row_hash(dst, board[dst]);
+      board[dst] = 0;
+      colors[dst] = 0;
+    }
+    tg_update_heights();
+    return __builtin_popcount(full);
   }
 
   /*
@@ -368,20 +500,9 @@ namespace tetris{
   /*
     Return true if the game is over.
   */
-  bool tetris_game::tg_game_over()
+  bool tetris_game::tg_game_over() const
   {
-    int i, j;
-    bool over = false;
-    tg_remove(falling);
-    for (i = 0; i < 2; i++) {
-      for (j = 0; j < cols; j++) {
-        if (TC_IS_FILLED(tg_get(i, j))) {
-          over = true;
-        }
-      }
-    }
-    tg_put(falling);
-    return over;
+    return (board[0] | board[1]) != 0;
   }
 
   /*******************************************************************************
@@ -396,39 +517,160 @@ namespace tetris{
   */
   bool tetris_game::tg_tick(tetris_move move)
   {
+    TRACE_SPAN("tg_tick");
     int lines_cleared;
+    bool over;
     // Handle gravity.
-    tg_do_gravity_tick();
+    {
+      TRACE_SPAN("gravity");
+      tg_do_gravity_tick();
+    }
 
     // Handle input.
-    tg_handle_move(move);
+    {
+      TRACE_SPAN("move");
+      tg_handle_move(move);
+    }
 
     // Check for cleared lines
-    lines_cleared = tg_check_lines();
+    {
+      TRACE_SPAN("check_lines");
+      lines_cleared = tg_check_lines();
+    }
 
-    tg_adjust_score(lines_cleared);
+    {
+      TRACE_SPAN("score");
+      tg_adjust_score(lines_cleared);
+    }
+
+    {
+      TRACE_SPAN("game_over");
+      over = tg_game_over();
+    }
 
     // Return whether the game will continue (NOT whether it's over)
-    return !tg_game_over();
+    return !over;
+  }
+
+  long tetris_game::tg_advance(long ticks, bool &running)
+  {
+    TRACE_SPAN("tg_advance");
+    // A TM_NONE tick that doesn't bring gravity only decrements the counter:
+    // no move, nothing locked, so no lines and no change to the score.
+    long quiet = MIN(MAX(ticks, 0), MAX(ticks_till_gravity - 1, 0));
+    ticks_till_gravity -= quiet;
+    if (quiet >= ticks) {
+      running = !tg_game_over();
+      return quiet;
+    }
+    running = tg_tick(TM_NONE);
+    return quiet + 1;
+  }
+
+  int tetris_game::tg_place(tetris_block block)
+  {
+    int lines_cleared;
+    tg_put(block);
+    tg_new_falling();
+    lines_cleared = tg_check_lines();
+    tg_adjust_score(lines_cleared);
+    return tg_game_over() ? -1 : lines_cleared;
   }
 
-  tetris_game::tetris_game(int rows, int cols){
+  int tetris_game::tg_place(tetris_block block, tetris_undo &undo)
+  {
+    tetris_row pending;
+    int i, n = 0;
+    undo.block = block;
+    undo.falling = falling;
+    undo.next = next;
+    undo.pieces = pieces;
+    undo.hash = hash;
+    undo.locked_rows = locked_rows;
+    undo.points = points;
+    undo.level = level;
+    undo.lines_remaining = lines_remaining;
+
+    tg_put(block);
+    tg_new_falling();
+    // Save the rows that are about to be cleared.
+    undo.cleared = 0;
+    for (pending = locked_rows; pending; pending &= pending - 1) {
+      i = __builtin_ctz(pending);
+      if (tg_line_full(i)) {
+        undo.cleared |= tetris_row(1) << i;
+        undo.rows[n] = board[i];
+        undo.colors[n++] = colors[i];
+      }
+    }
+    tg_check_lines();
+    tg_adjust_score(n);
+    return tg_game_over() ? -1 : n;
+  }
+
+  void tetris_game::tg_undo(const tetris_undo &undo)
+  {
+    const tetris_shape &shape = TETROMINO_SHAPES[undo.block.typ][undo.block.ori];
+    const tetris_mask &mask =
+      TETROMINO_MASKS[undo.block.typ][undo.block.ori][undo.block.loc.col + MASK_COL_OFFSET];
+    int i, r, src, n = 0;
+
+    // Undo the compaction from the top down: row i comes back from i plus the
+    // number of cleared rows below it, and the cleared rows from undo.
+    if (undo.cleared) {
+      src = __builtin_popcount(undo.cleared);
+      for (i = 0; i <= 31 - __builtin_clz(undo.cleared); i++) {
+        if ((undo.cleared >> i) & 1) {
+          board[i] = undo.rows[n];
+          colors[i] = undo.colors[n++];
+        } else {
+          board[i] = board[src];
+          colors[i] = colors[src];
+          src++;
+        }
+      }
+    }
+
+    // Take the block back out.  Its cells were empty before it locked.
+    for (i = 0; i < shape.height; i++) {
+      r = undo.block.loc.row + shape.top + i;
+      if (r < 0 || r >= rows)
+        continue;
+      board[r] &= ~mask[i];
+      colors[r] &= ~(shift_colors(shape.colors[i], undo.block.loc.col) * 0xF);
+    }
+    tg_update_heights();
+
+    falling = undo.falling;
+    next = undo.next;
+    pieces = undo.pieces;
+    hash = undo.hash;
+    locked_rows = undo.locked_rows;
+    points = undo.points;
+    level = undo.level;
+    lines_remaining = undo.lines_remaining;
+  }
+
+  tetris_game::tetris_game(int rows, int cols, std::uint64_t seed,
+                           tetris_randomizer randomizer)
+    : seed(seed), pieces(seed, randomizer) {
+      if (!tg_valid_size(rows, cols))
+        throw std::invalid_argument("tetris_game: board size out of range");
       this->rows = rows;
       this->cols = cols;
-      board = std::string(this->rows * this->cols, TC_EMPTY);
+      board.fill(0);
+      colors.fill(0);
+      full_row = (tetris_row(1) << this->cols) - 1;
+      locked_rows = 0;
+      heights.fill(0);
+      hash = 0;
       points = 0;
       level = 0;
       ticks_till_gravity = GRAVITY_LEVEL[level];
       lines_remaining = LINES_PER_LEVEL;
-      //TODO: change random generator
-      srand(time(nullptr));
       this->tg_new_falling();
       this->tg_new_falling();
-      stored.typ = -1;
-      stored.ori = 0;
-      stored.loc.row = 0;
-      next.loc.col = this->cols/2 - 2;
-      std::cout << falling.loc.col;
+      stored = tetris_block{-1, 0, {0, 0}};
   }
 
   /*void tg_destroy()
@@ -442,41 +684,45 @@ namespace tetris{
     // free();
   }
   */
-  // /*
-  //   Load a game from a file.
-  //  */
-  // tetris_game *tg_load(FILE *f)
-  // {
-  //   tetris_game *obj = (tetris_game*) malloc(sizeof(tetris_game));
-  //   fread(sizeof(tetris_game), 1, f);
-  //   board = (char*) malloc(rows * cols);
-  //   fread(board, sizeof(char), rows * cols, f);
-  //   return obj;
-  // }
-
-  // /*
-  //   Save a game to a file.
-  //  */
-  // void tg_save(tetris_game *obj, FILE *f)
-  // {
-  //   fwrite(obj, sizeof(tetris_game), 1, f);
-  //   fwrite(board, sizeof(char), rows * cols, f);
-  // }
+  /*
+    Load a game from a snapshot file.
+   */
+  bool tetris_game::tg_load(FILE *f)
+  {
+    std::uint8_t header[SNAPSHOT_HEADER_BYTES];
+    std::uint64_t count;
+    tetris_packed packed;
+    return fread(header, sizeof(header), 1, f) == 1 &&
+      ts_read_header(header, count) && count >= 1 &&
+      fread(packed.bytes.data(), PACKED_BYTES, 1, f) == 1 &&
+      tg_unpack(packed);
+  }
+
+  /*
+    Save a game to a file.
+   */
+  bool tetris_game::tg_save(FILE *f) const
+  {
+    tetris_packed packed;
+    return tg_pack(packed) && ts_write_header(f, 1) &&
+      fwrite(packed.bytes.data(), PACKED_BYTES, 1, f) == 1;
+  }
 
   /*
     Print a game board to a file.  Really just for early debugging.
   */
-  // void tg_print(tetris_game *obj, FILE *f) {
-  //   int i, j;
-  //   for (i = 0; i < rows; i++) {
-  //     for (j = 0; j < cols; j++) {
-  //       if (TC_IS_EMPTY(tg_get(obj, i, j))) {
-  //         fputs(TC_EMPTY_STR, f);
-  //       } else {
-  //         fputs(TC_BLOCK_STR, f);
-  //       }
-  //     }
-  //     fputc('\n', f);
-  //   }
-  // }
-}
\ No newline at end of file
+  void tetris_game::tg_print(FILE *f) const
+  {
+    int i, j;
+    for (i = 0; i < rows; i++) {
+      for (j = 0; j < cols; j++) {
+        if (TC_IS_EMPTY(tg_get(i, j))) {
+          fputc(TC_EMPTY_STR, f);
+        } else {
+          fputs(TC_BLOCK_STR, f);
+        }
+      }
+      fputc('\n', f);
+    }
+  }
+}
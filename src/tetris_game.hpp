@@ -16,7 +16,11 @@
 #pragma once
 #include "tetris_block.hpp"
 #include "tetris_location.hpp"
-#include <string>
+#include "tetris_random.hpp"
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
 
 namespace tetris{
    /*
@@ -51,7 +55,7 @@ namespace tetris{
     Strings for how you would print a tetris board.
   */
   constexpr char TC_EMPTY_STR = ' ';
-  // constexpr std::string_view TC_BLOCK_STR = "\u2588";
+  constexpr const char *TC_BLOCK_STR = "\u2588";
 
   /*
     Questions about a tetris cell.
@@ -82,19 +86,119 @@ namespace tetris{
   constexpr unsigned short MAX_LEVEL = 19;
   constexpr unsigned short LINES_PER_LEVEL = 10;
 
+  /*
+    Board size limits.  Every row of the board is one word, with one bit per
+    column, and the cell colours take four bits per column in a second word.
+  */
+  constexpr unsigned short MAX_ROWS = 32;
+  constexpr unsigned short MAX_COLS = 16;
+  /*
+    New blocks appear at column cols/2 - 2 and are up to four cells wide.
+  */
+  constexpr unsigned short MIN_COLS = 4;
+
+  /*
+    Whether a board of rows x cols can be played: 1 to MAX_ROWS rows and
+    MIN_COLS to MAX_COLS columns.
+  */
+  constexpr bool tg_valid_size(int rows, int cols)
+  {
+    return rows >= 1 && rows <= MAX_ROWS && cols >= MIN_COLS &&
+           cols <= MAX_COLS;
+  }
+  typedef std::uint32_t tetris_row;
+  typedef std::uint64_t tetris_color_row;
+  constexpr unsigned short BITS_PER_COLOR = 4;
+
+  /*
+    Zobrist keys: a random word for every cell.  The hash of a board is the XOR
+    of the keys of its filled cells, so setting or clearing a cell is one XOR.
+  */
+  constexpr std::uint64_t splitmix64(std::uint64_t &x)
+  {
+    std::uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  constexpr std::array<std::array<std::uint64_t, MAX_COLS>, MAX_ROWS>
+  make_zobrist()
+  {
+    std::array<std::array<std::uint64_t, MAX_COLS>, MAX_ROWS> z{};
+    std::uint64_t x = 0;
+    for (int r = 0; r < MAX_ROWS; r++) {
+      for (int c = 0; c < MAX_COLS; c++) {
+        z[r][c] = splitmix64(x);
+      }
+    }
+    return z;
+  }
+
+  constexpr auto ZOBRIST = make_zobrist();
+
  
+  class tetris_placements;
+  struct tetris_packed;
+
+  /*
+    What tg_place changed, so that tg_undo can put it back: the block it
+    locked, the rows it cleared (bit r of cleared for each, with their cells in
+    order from the top), and the small state it overwrote.
+  */
+  struct tetris_undo {
+    tetris_block block;
+    tetris_block falling;
+    tetris_block next;
+    tetris_pieces pieces;
+    std::uint64_t hash;
+    tetris_row locked_rows;
+    tetris_row cleared;
+    tetris_row rows[TETRIS];
+    tetris_color_row colors[TETRIS];
+    int points;
+    int level;
+    int lines_remaining;
+  };
+
   /*
     A game object!
   */
   class tetris_game {
 
+    // The benchmarks (src/tools/bench.cpp) time the private steps directly.
+    friend class tetris_bench;
+
     private:
       /*
         Game board stuff:
       */
       int rows;
       int cols;
-      std::string board; 
+      /*
+        Bit c of board[r] is set when the cell at (r, c) holds a locked block;
+        the falling block is never written here.  The colour of each cell is
+        kept in a separate plane, which only tg_get and tg_put look at.
+      */
+      std::array<tetris_row, MAX_ROWS> board;
+      std::array<tetris_color_row, MAX_ROWS> colors;
+      tetris_row full_row;
+      /*
+        Set of rows (bit r for row r) written by tg_put since the last
+        tg_check_lines.  MAX_ROWS is small enough to fit them in a row word.
+      */
+      tetris_row locked_rows;
+      /*
+        Height of the stack in each column: rows minus the index of the highest
+        locked cell, or 0 for an empty column.  Kept up to date by tg_put and
+        tg_check_lines.
+      */
+      std::array<int, MAX_COLS> heights;
+      /*
+        Zobrist hash of the locked cells, kept up to date by tg_set, tg_put and
+        tg_check_lines.
+      */
+      std::uint64_t hash;
       /*
         Scoring information:
       */
@@ -107,6 +211,11 @@ namespace tetris{
       tetris_block falling;
       tetris_block next;
       tetris_block stored;
+      /*
+        Seed the game was created with, and the pieces coming after next.
+      */
+      std::uint64_t seed;
+      tetris_pieces pieces;
       /*
         Number of game ticks until the block will move down.
       */
@@ -119,18 +228,17 @@ namespace tetris{
       bool tg_fits (tetris_block block) const;
       void tg_set(int row, int column, char value);
       void tg_put(tetris_block block);
-      void tg_remove(tetris_block block);
       void tg_move(int direction);
       void tg_down();
+      tetris_block tg_rotated(tetris_block block, int direction) const;
       void tg_rotate(int direction);
       void tg_hold();
       void tg_handle_move(tetris_move move);
       bool tg_line_full (int i) const;
-      void tg_shift_lines(int r);
+      void tg_update_heights();
       int tg_check_lines();
       void tg_adjust_score(int lines_cleared);
-      bool tg_game_over();
-      static int random_tetromino();
+      bool tg_game_over() const;
 
     public:
       int get_rows() const;
@@ -142,10 +250,32 @@ namespace tetris{
       tetris_block get_stored() const;
       int get_ticks_till_gravity() const;
       int get_lines_remaining() const;
+      int get_height(int col) const;
+      /*
+        Locked cells of row r, one bit per column, and their Zobrist hash.
+      */
+      tetris_row get_row(int r) const;
+      /*
+        Locked cells of row r as a tetris_cell every BITS_PER_COLOR bits.
+      */
+      tetris_color_row get_color_row(int r) const;
+      std::uint64_t get_hash() const;
+      std::uint64_t get_seed() const;
+      tetris_randomizer get_randomizer() const;
+      /*
+        Type of the tetromino i places after next, for 0 <= i < NUM_PREVIEW.
+      */
+      int get_preview(int i) const;
     
     
 
-      tetris_game(int rows, int cols);
+      /*
+        The piece sequence depends only on seed and randomizer, so two games
+        created alike and given the same moves play out identically.  Throws
+        std::invalid_argument for a size that isn't tg_valid_size.
+      */
+      tetris_game(int rows, int cols, std::uint64_t seed,
+                  tetris_randomizer randomizer = TR_UNIFORM);
       void tg_new_falling();
       void tg_do_gravity_tick();
       // Data structure manipulation.
@@ -153,17 +283,69 @@ namespace tetris{
       tetris_game *tg_create(int rows, int cols);
       void tg_destroy();
       void tg_delete();
-      // tetris_game *tg_load(FILE *f);
-      // void tg_save(FILE *f);
+      /*
+        Save the game to f as a snapshot file of one record, or load the first
+        record of a snapshot file (see tetris_snapshot.hpp).  False on a read or
+        write error, or if the game doesn't fit the packed format.
+      */
+      bool tg_load(FILE *f);
+      bool tg_save(FILE *f) const;
 
       // Public methods not related to memory:
       char tg_get(int row, int col) const;
       bool tg_check(int row, int col) const;
       bool tg_tick(tetris_move move);
-      // void tg_print(FILE *f);
+      /*
+        Play up to ticks ticks of TM_NONE, stopping after the first one in which
+        gravity moves or locks the falling block.  The ticks before it only
+        count down to gravity, so they are skipped in one step; the game ends
+        up exactly as that many tg_tick(TM_NONE) calls would leave it.  Returns
+        the ticks played and sets running as tg_tick would.
+      */
+      long tg_advance(long ticks, bool &running);
+      int tg_drop_distance(tetris_block block) const;
+      tetris_block tg_ghost() const;
+      tetris_block tg_spawn(int typ) const;
+      /*
+        Find every distinct resting place the block start can reach with
+        left, right, rotation and gravity, each with its shortest input sequence
+        (see tetris_placement.hpp).  Pass get_falling(), or tg_spawn(typ) for a
+        piece that hasn't appeared yet.
+      */
+      void tg_placements(tetris_block start, tetris_placements &out) const;
+      /*
+        Lock the falling block at block, a place it can reach, as TM_DROP would
+        from there, without any gravity tick.  Returns the number of lines
+        cleared, or -1 if that ended the game.
+      */
+      int tg_place(tetris_block block);
+      /*
+        tg_place, recording in undo what tg_undo needs to return the game to
+        exactly how it was.  Undo in the reverse order of placing.
+      */
+      int tg_place(tetris_block block, tetris_undo &undo);
+      void tg_undo(const tetris_undo &undo);
+      /*
+        Write the game to out, or read it back from in (see tetris_packed.hpp).
+        A game read back plays on exactly as the one written would.  Both
+        return false, leaving the target alone, for boards larger than
+        PACKED_ROWS x PACKED_COLS or data that is not a valid state.
+      */
+      bool tg_pack(tetris_packed &out) const;
+      bool tg_unpack(const tetris_packed &in);
+      void tg_print(FILE *f) const;
 
   };
 
+  /*
+    A game is one flat block of memory, so copying or resetting one is a
+    memcpy and states can live in a tetris_arena.
+  */
+  static_assert(std::is_trivially_copyable<tetris_game>::value,
+                "tetris_game must stay trivially copyable");
+  static_assert(std::is_trivially_destructible<tetris_game>::value,
+                "tetris_game must stay trivially destructible");
+
 
   /*
     This array stores all necessary information about the cells that are filled by
@@ -210,6 +392,91 @@ namespace tetris{
     {{0, 1}, {1, 0}, {1, 1}, {2, 0}}},
   };
 
+  /*
+    Collision data for one orientation of a tetromino, derived from TETROMINOS.
+    top/bottom/left/right bound the occupied cells relative to the origin.
+    rows[i] has bit c set when the cell (top + i, c) is filled, and colors[i]
+    holds a 1 in the colour nibble of each of those cells.  profile[c] is the
+    row of the lowest cell in column c, or -1 if the column is empty.
+  */
+  struct tetris_shape {
+    int top, bottom, left, right;
+    int height;
+    tetris_row rows[TETRIS];
+    tetris_color_row colors[TETRIS];
+    int profile[TETRIS];
+  };
+
+  constexpr tetris_shape make_shape(const tetris_location (&cells)[TETRIS])
+  {
+    tetris_shape s{cells[0].row, cells[0].row, cells[0].col, cells[0].col, 0,
+                   {}, {}, {-1, -1, -1, -1}};
+    for (int i = 1; i < TETRIS; i++) {
+      s.top = cells[i].row < s.top ? cells[i].row : s.top;
+      s.bottom = cells[i].row > s.bottom ? cells[i].row : s.bottom;
+      s.left = cells[i].col < s.left ? cells[i].col : s.left;
+      s.right = cells[i].col > s.right ? cells[i].col : s.right;
+    }
+    s.height = s.bottom - s.top + 1;
+    for (int i = 0; i < TETRIS; i++) {
+      s.rows[cells[i].row - s.top] |= tetris_row(1) << cells[i].col;
+      s.colors[cells[i].row - s.top] |=
+        tetris_color_row(1) << (BITS_PER_COLOR * cells[i].col);
+      if (cells[i].row > s.profile[cells[i].col])
+        s.profile[cells[i].col] = cells[i].row;
+    }
+    return s;
+  }
+
+  constexpr std::array<std::array<tetris_shape, NUM_ORIENTATIONS>, NUM_TETROMINOS>
+  make_shapes()
+  {
+    std::array<std::array<tetris_shape, NUM_ORIENTATIONS>, NUM_TETROMINOS> s{};
+    for (int t = 0; t < NUM_TETROMINOS; t++) {
+      for (int o = 0; o < NUM_ORIENTATIONS; o++) {
+        s[t][o] = make_shape(TETROMINOS[t][o]);
+      }
+    }
+    return s;
+  }
+
+  constexpr auto TETROMINO_SHAPES = make_shapes();
+
+  /*
+    Row masks for every tetromino, orientation and origin column, already shifted
+    into place: TETROMINO_MASKS[typ][ori][col + MASK_COL_OFFSET][i] is the mask
+    for board row (origin row + top + i).  An origin may sit left of column 0 as
+    long as the cells themselves are on the board, hence the offset.
+  */
+  constexpr int MASK_COL_OFFSET = TETRIS - 1;
+  constexpr int MASK_COLS = MAX_COLS + MASK_COL_OFFSET;
+  typedef std::array<tetris_row, TETRIS> tetris_mask;
+
+  constexpr std::array<std::array<std::array<tetris_mask, MASK_COLS>,
+                                  NUM_ORIENTATIONS>, NUM_TETROMINOS>
+  make_masks()
+  {
+    std::array<std::array<std::array<tetris_mask, MASK_COLS>,
+                          NUM_ORIENTATIONS>, NUM_TETROMINOS> m{};
+    for (int t = 0; t < NUM_TETROMINOS; t++) {
+      for (int o = 0; o < NUM_ORIENTATIONS; o++) {
+        const tetris_shape &s = TETROMINO_SHAPES[t][o];
+        for (int c = -MASK_COL_OFFSET; c < MAX_COLS; c++) {
+          // Only columns that keep every cell within [0, MAX_COLS) are legal.
+          if (c + s.left < 0 || c + s.right >= MAX_COLS)
+            continue;
+          for (int i = 0; i < s.height; i++) {
+            m[t][o][c + MASK_COL_OFFSET][i] = c >= 0 ? s.rows[i] << c
+                                                     : s.rows[i] >> -c;
+          }
+        }
+      }
+    }
+    return m;
+  }
+
+  constexpr auto TETROMINO_MASKS = make_masks();
+
   /*
     This array tells you how many ticks per gravity by level.  Decreases as level
     increases, to add difficulty.
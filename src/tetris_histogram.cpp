@@ -0,0 +1,120 @@
+/***************************************************************************//**
+
+  @file         tetris_histogram.cpp
+
+  @brief        Fixed-size histograms of durations, for latency reports.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_histogram.hpp"
+#include <cmath>
+
+namespace tetris{
+
+  /*
+    Percentiles in a printed row.
+  */
+  constexpr double HISTOGRAM_PERCENTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+  tetris_histogram::tetris_histogram()
+    : count(0), max(0)
+  {
+    for (std::atomic<std::uint64_t> &c : counts) {
+      c.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /*
+    Values below HISTOGRAM_SUBS have a bucket each.  Above that, the leading
+    one picks a group of HISTOGRAM_SUBS buckets and the next HISTOGRAM_SUB_BITS
+    bits pick one within it.
+  */
+  int tetris_histogram::th_bucket(std::uint64_t value)
+  {
+    if (value < HISTOGRAM_SUBS)
+      return (int) value;
+    int top = 63 - __builtin_clzll(value);
+    int shift = top - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUBS +
+           (int) ((value >> shift) & (HISTOGRAM_SUBS - 1));
+  }
+
+  std::uint64_t tetris_histogram::th_highest(int i)
+  {
+    if (i < HISTOGRAM_SUBS)
+      return i;
+    int shift = i / HISTOGRAM_SUBS - 1;
+    std::uint64_t low = std::uint64_t(HISTOGRAM_SUBS + i % HISTOGRAM_SUBS)
+                        << shift;
+    return low + ((std::uint64_t(1) << shift) - 1);
+  }
+
+  void tetris_histogram::th_record(std::uint64_t nanoseconds)
+  {
+    // Only this thread writes, so a plain load and store is enough; the atomics
+    // are there for readers on other threads.
+    std::atomic<std::uint64_t> &c = counts[th_bucket(nanoseconds)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    if (nanoseconds > max.load(std::memory_order_relaxed))
+      max.store(nanoseconds, std::memory_order_relaxed);
+  }
+
+  void tetris_histogram::th_record(std::chrono::steady_clock::duration elapsed)
+  {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+    th_record(ns.count() > 0 ? (std::uint64_t) ns.count() : 0);
+  }
+
+  std::uint64_t tetris_histogram::th_percentile(double fraction) const
+  {
+    std::uint64_t total = 0, seen = 0, rank, highest;
+    int i;
+    for (const std::atomic<std::uint64_t> &c : counts) {
+      total += c.load(std::memory_order_relaxed);
+    }
+    if (total == 0)
+      return 0;
+    // The smallest value with at least rank values at or below it.
+    rank = (std::uint64_t) std::ceil(fraction * total);
+    rank = rank < 1 ? 1 : rank > total ? total : rank;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+      seen += counts[i].load(std::memory_order_relaxed);
+      if (seen >= rank)
+        break;
+    }
+    highest = th_highest(i);
+    return highest < get_max() ? highest : get_max();
+  }
+
+  std::uint64_t tetris_histogram::get_count() const
+  {
+    return count.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t tetris_histogram::get_max() const
+  {
+    return max.load(std::memory_order_relaxed);
+  }
+
+  void tetris_histogram::th_print_header(FILE *f)
+  {
+    fprintf(f, "%-16s %10s", "(microseconds)", "count");
+    for (double p : HISTOGRAM_PERCENTILES) {
+      fprintf(f, " %9gth", 100 * p);
+    }
+    fprintf(f, " %11s\n", "max");
+  }
+
+  void tetris_histogram::th_print(FILE *f, const char *name) const
+  {
+    fprintf(f, "%-16s %10llu", name, (unsigned long long) get_count());
+    for (double p : HISTOGRAM_PERCENTILES) {
+      fprintf(f, " %11.1f", th_percentile(p) / 1000.0);
+    }
+    fprintf(f, " %11.1f\n", get_max() / 1000.0);
+  }
+}
@@ -0,0 +1,75 @@
+/***************************************************************************//**
+
+  @file         tetris_histogram.hpp
+
+  @brief        Fixed-size histograms of durations, for latency reports.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+namespace tetris{
+
+  /*
+    Bits below the leading one that a bucket keeps: each power of two is split
+    into 1 << HISTOGRAM_SUB_BITS buckets, so a value is known to within 1 part
+    in 16 whatever its size, the way HDR histograms do it.
+  */
+  constexpr int HISTOGRAM_SUB_BITS = 4;
+  constexpr int HISTOGRAM_SUBS = 1 << HISTOGRAM_SUB_BITS;
+  constexpr int HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) *
+                                    HISTOGRAM_SUBS;
+
+  /*
+    Counts of durations in nanoseconds, from 0 to the full 64 bits, in a fixed
+    HISTOGRAM_BUCKETS counters: recording is a shift, a count leading zeros and
+    an increment, with nothing allocated.  One thread records; any thread may
+    read the counts at any time, and sees them as they were at some recent
+    moment.
+  */
+  class tetris_histogram {
+
+    private:
+      std::array<std::atomic<std::uint64_t>, HISTOGRAM_BUCKETS> counts;
+      std::atomic<std::uint64_t> count;
+      std::atomic<std::uint64_t> max;
+
+      static int th_bucket(std::uint64_t value);
+      /*
+        Largest value that goes in bucket i.
+      */
+      static std::uint64_t th_highest(int i);
+
+    public:
+      tetris_histogram();
+      tetris_histogram(const tetris_histogram &) = delete;
+      tetris_histogram &operator=(const tetris_histogram &) = delete;
+
+      void th_record(std::uint64_t nanoseconds);
+      void th_record(std::chrono::steady_clock::duration elapsed);
+      /*
+        The value below which fraction of the recorded values fall, to within
+        a bucket, or 0 if nothing was recorded.
+      */
+      std::uint64_t th_percentile(double fraction) const;
+      std::uint64_t get_count() const;
+      std::uint64_t get_max() const;
+
+      /*
+        Print the column headings for th_print.
+      */
+      static void th_print_header(FILE *f);
+      /*
+        Print a row of the count and percentiles, in microseconds.
+      */
+      void th_print(FILE *f, const char *name) const;
+  };
+}
@@ -0,0 +1,233 @@
+/***************************************************************************//**
+
+  @file         tetris_packed.cpp
+
+  @brief        Fixed-size packed encoding of a game.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_packed.hpp"
+
+namespace tetris{
+
+  /*
+    Bits of colour stored per cell, and the offset of the origin fields.
+  */
+  constexpr int PACKED_COLOR_BITS = 3;
+  constexpr int PACKED_LOC_OFFSET = TETRIS - 1;
+
+  static_assert(TC_CELLZ < (1 << PACKED_COLOR_BITS),
+                "every cell fits in PACKED_COLOR_BITS");
+  static_assert(PACKED_ROWS <= MAX_ROWS && PACKED_COLS <= MAX_COLS,
+                "a packed board must fit in a game");
+
+  /*
+    Writes fields of up to 32 bits into a byte array, lowest bit first.
+  */
+  class bit_writer {
+
+    private:
+      std::uint8_t *out;
+      std::uint64_t bits;
+      int used;
+
+    public:
+      explicit bit_writer(std::uint8_t *out) : out(out), bits(0), used(0) {}
+
+      void put(std::uint64_t value, int width)
+      {
+        bits |= (value & ((std::uint64_t(1) << width) - 1)) << used;
+        used += width;
+        for (; used >= 8; used -= 8) {
+          *out++ = (std::uint8_t) bits;
+          bits >>= 8;
+        }
+      }
+
+      void put64(std::uint64_t value)
+      {
+        put(value & 0xFFFFFFFF, 32);
+        put(value >> 32, 32);
+      }
+
+      void flush()
+      {
+        if (used > 0)
+          put(0, 8 - used);
+      }
+  };
+
+  /*
+    Reads back what a bit_writer wrote.
+  */
+  class bit_reader {
+
+    private:
+      const std::uint8_t *in;
+      std::uint64_t bits;
+      int held;
+
+    public:
+      explicit bit_reader(const std::uint8_t *in) : in(in), bits(0), held(0) {}
+
+      std::uint64_t get(int width)
+      {
+        std::uint64_t value;
+        for (; held < width; held += 8) {
+          bits |= std::uint64_t(*in++) << held;
+        }
+        value = bits & ((std::uint64_t(1) << width) - 1);
+        bits >>= width;
+        held -= width;
+        return value;
+      }
+
+      std::uint64_t get64()
+      {
+        std::uint64_t low = get(32);
+        return low | get(32) << 32;
+      }
+
+      /*
+        Sign-extend a field read with get.
+      */
+      std::int64_t get_signed(int width)
+      {
+        std::uint64_t value = get(width);
+        std::uint64_t sign = std::uint64_t(1) << (width - 1);
+        return (std::int64_t) ((value ^ sign) - sign);
+      }
+  };
+
+  static bool fits_signed(long value, int width)
+  {
+    return value >= -(1L << (width - 1)) && value < (1L << (width - 1));
+  }
+
+  static bool fits_unsigned(long value, int width)
+  {
+    return value >= 0 && value < (1L << width);
+  }
+
+  bool tetris_game::tg_pack(tetris_packed &out) const
+  {
+    int r, c, i;
+    if (rows > PACKED_ROWS || cols > PACKED_COLS ||
+        !fits_signed(ticks_till_gravity, 16) ||
+        !fits_unsigned(falling.loc.row + PACKED_LOC_OFFSET, 6) ||
+        !fits_unsigned(falling.loc.col + PACKED_LOC_OFFSET, 5))
+      return false;
+
+    out.bytes.fill(0);
+    bit_writer w(out.bytes.data());
+    w.put(rows - 1, 5);
+    w.put(cols - 1, 4);
+    w.put(level, 5);
+    w.put(lines_remaining, 4);
+    w.put(ticks_till_gravity, 16);
+    w.put(falling.typ, 3);
+    w.put(falling.ori, 2);
+    w.put(falling.loc.row + PACKED_LOC_OFFSET, 6);
+    w.put(falling.loc.col + PACKED_LOC_OFFSET, 5);
+    w.put(next.typ, 3);
+    w.put(stored.typ + 1, 3);
+    w.put(stored.ori, 2);
+    w.put(pieces.get_randomizer(), 1);
+    w.put(pieces.get_count(), 4);
+    for (i = 0; i < MAX_QUEUED; i++) {
+      w.put(i < pieces.get_count() ? pieces.get_queued(i) : 0, 3);
+    }
+    w.put((std::uint32_t) points, 32);
+    w.put64(seed);
+    w.put64(pieces.get_state());
+    for (r = 0; r < PACKED_ROWS; r++) {
+      std::uint64_t row = 0;
+      for (c = 0; r < rows && c < cols; c++) {
+        row |= ((colors[r] >> (BITS_PER_COLOR * c)) & 0xF)
+          << (PACKED_COLOR_BITS * c);
+      }
+      w.put(row, PACKED_COLOR_BITS * PACKED_COLS);
+    }
+    w.flush();
+    return true;
+  }
+
+  bool tetris_game::tg_unpack(const tetris_packed &in)
+  {
+    std::uint8_t queued[MAX_QUEUED];
+    tetris_color_row unpacked[PACKED_ROWS];
+    int r, c, i, new_rows, new_cols, new_level, new_remaining, next_typ, count;
+    tetris_block new_falling, new_stored;
+
+    bit_reader b(in.bytes.data());
+    new_rows = b.get(5) + 1;
+    new_cols = b.get(4) + 1;
+    new_level = b.get(5);
+    new_remaining = b.get(4);
+    int new_ticks = b.get_signed(16);
+    new_falling.typ = b.get(3);
+    new_falling.ori = b.get(2);
+    new_falling.loc.row = (int) b.get(6) - PACKED_LOC_OFFSET;
+    new_falling.loc.col = (int) b.get(5) - PACKED_LOC_OFFSET;
+    next_typ = b.get(3);
+    new_stored = tetris_block{(int) b.get(3) - 1, 0, {0, 0}};
+    new_stored.ori = b.get(2);
+    tetris_randomizer randomizer = (tetris_randomizer) b.get(1);
+    count = b.get(4);
+    bool valid = new_rows <= PACKED_ROWS && new_cols <= PACKED_COLS &&
+      new_level <= MAX_LEVEL && new_remaining >= 1 &&
+      new_remaining <= LINES_PER_LEVEL && new_falling.typ < NUM_TETROMINOS &&
+      new_falling.loc.row < new_rows && new_falling.loc.col < new_cols &&
+      next_typ < NUM_TETROMINOS && new_stored.typ < NUM_TETROMINOS &&
+      count > NUM_PREVIEW && count <= MAX_QUEUED;
+    for (i = 0; i < MAX_QUEUED; i++) {
+      queued[i] = b.get(3);
+      valid = valid && (i >= count || queued[i] < NUM_TETROMINOS);
+    }
+    int new_points = (std::int32_t) b.get(32);
+    std::uint64_t new_seed = b.get64();
+    std::uint64_t state = b.get64();
+    for (r = 0; r < PACKED_ROWS; r++) {
+      std::uint64_t row = b.get(PACKED_COLOR_BITS * PACKED_COLS);
+      unpacked[r] = 0;
+      for (c = 0; c < PACKED_COLS; c++) {
+        tetris_color_row cell = (row >> (PACKED_COLOR_BITS * c))
+          & ((1 << PACKED_COLOR_BITS) - 1);
+        valid = valid && (cell == TC_EMPTY || (r < new_rows && c < new_cols));
+        unpacked[r] |= cell << (BITS_PER_COLOR * c);
+      }
+    }
+    if (!valid)
+      return false;
+
+    rows = new_rows;
+    cols = new_cols;
+    board.fill(0);
+    colors.fill(0);
+    full_row = (tetris_row(1) << cols) - 1;
+    locked_rows = 0;
+    hash = 0;
+    for (r = 0; r < rows; r++) {
+      colors[r] = unpacked[r];
+      for (c = 0; c < cols; c++) {
+        if ((unpacked[r] >> (BITS_PER_COLOR * c)) & 0xF) {
+          board[r] |= tetris_row(1) << c;
+          hash ^= ZOBRIST[r][c];
+        }
+      }
+    }
+    tg_update_heights();
+    points = new_points;
+    level = new_level;
+    falling = new_falling;
+    next = tg_spawn(next_typ);
+    stored = new_stored;
+    seed = new_seed;
+    pieces.tp_restore(state, randomizer, queued, count);
+    ticks_till_gravity = new_ticks;
+    lines_remaining = new_remaining;
+    return true;
+  }
+}
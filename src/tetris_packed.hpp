@@ -0,0 +1,83 @@
+/***************************************************************************//**
+
+  @file         tetris_packed.hpp
+
+  @brief        Fixed-size packed encoding of a game.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_game.hpp"
+#include <array>
+#include <cstdint>
+
+namespace tetris{
+
+  /*
+    Largest board that fits in a packed state.
+  */
+  constexpr unsigned short PACKED_ROWS = 24;
+  constexpr unsigned short PACKED_COLS = 10;
+  constexpr unsigned short PACKED_BYTES = 128;
+
+  /*
+    A whole game in PACKED_BYTES bytes, the same on every machine.  Fields are
+    written one after another as a bit stream, each least significant bit
+    first, filling every byte from bit 0 up: a field at bit offset b starts at
+    bit (b % 8) of bytes[b / 8].  Signed fields are two's complement.
+
+      bits  field
+         5  rows - 1
+         4  cols - 1
+         5  level
+         4  lines remaining
+        16  ticks till gravity
+         3  falling type
+         2  falling orientation
+         6  falling row + 3
+         5  falling column + 3
+         3  next type
+         3  stored type + 1 (0 for none)
+         2  stored orientation
+         1  randomizer
+         4  pieces queued
+     12x 3  queued pieces, the next one to come first
+        32  points
+        64  seed
+        64  generator state
+    24x30   rows, top first: 3 bits of colour (a tetris_cell) per column,
+            PACKED_COLS of them, left first
+
+    Everything after the last row is zero.  The board bits, heights and hash
+    follow from the colours, so they are rebuilt rather than stored.
+  */
+  struct tetris_packed {
+    std::array<std::uint8_t, PACKED_BYTES> bytes;
+  };
+
+  static_assert(sizeof(tetris_packed) == PACKED_BYTES,
+                "a packed state is exactly PACKED_BYTES bytes");
+
+  /*
+    Store or load an unsigned value in bytes little-endian bytes, for the file
+    headers around packed states.
+  */
+  inline void store_le(std::uint8_t *out, std::uint64_t value, int bytes)
+  {
+    for (int i = 0; i < bytes; i++) {
+      out[i] = (std::uint8_t) (value >> (8 * i));
+    }
+  }
+
+  inline std::uint64_t load_le(const std::uint8_t *in, int bytes)
+  {
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+      value |= std::uint64_t(in[i]) << (8 * i);
+    }
+    return value;
+  }
+}
@@ -0,0 +1,216 @@
+/***************************************************************************//**
+
+  @file         tetris_placement.cpp
+
+  @brief        Every place a falling block can come to rest.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_placement.hpp"
+
+namespace tetris{
+
+  #define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
+
+  /*
+    For each orientation, the first orientation of the same tetromino that
+    covers the same cells, and how far its origin has to move to do so.
+  */
+  struct tetris_symmetry {
+    int ori, drow, dcol;
+  };
+
+  constexpr bool same_cells(const tetris_shape &a, const tetris_shape &b)
+  {
+    if (a.height != b.height)
+      return false;
+    for (int i = 0; i < a.height; i++) {
+      if ((a.rows[i] >> a.left) != (b.rows[i] >> b.left))
+        return false;
+    }
+    return true;
+  }
+
+  constexpr std::array<std::array<tetris_symmetry, NUM_ORIENTATIONS>, NUM_TETROMINOS>
+  make_symmetries()
+  {
+    std::array<std::array<tetris_symmetry, NUM_ORIENTATIONS>, NUM_TETROMINOS> s{};
+    for (int t = 0; t < NUM_TETROMINOS; t++) {
+      for (int o = 0; o < NUM_ORIENTATIONS; o++) {
+        const tetris_shape &shape = TETROMINO_SHAPES[t][o];
+        for (int c = 0; c <= o; c++) {
+          const tetris_shape &first = TETROMINO_SHAPES[t][c];
+          if (same_cells(shape, first)) {
+            s[t][o] = {c, shape.top - first.top, shape.left - first.left};
+            break;
+          }
+        }
+      }
+    }
+    return s;
+  }
+
+  constexpr auto TETROMINO_SYMMETRIES = make_symmetries();
+
+  static int reach_index(int ori, int row)
+  {
+    return ori * REACH_ROWS + row + REACH_ROW_OFFSET;
+  }
+
+  static tetris_row reach_bit(int col)
+  {
+    return tetris_row(1) << (col + MASK_COL_OFFSET);
+  }
+
+  /*
+    Queue block, reached from node parent by count repeats of move, unless it
+    has been queued before.
+  */
+  bool tetris_placements::tps_visit(tetris_block block, tetris_move move,
+                                    int count, int parent)
+  {
+    tetris_row &row = seen[reach_index(block.ori, block.loc.row)];
+    tetris_row bit = reach_bit(block.loc.col);
+    if (row & bit)
+      return false;
+    row |= bit;
+    nodes[num_nodes++] = {
+      (std::int8_t) block.ori, (std::int8_t) block.loc.row,
+      (std::int8_t) block.loc.col, (std::int8_t) move, (std::int8_t) count,
+      (std::int16_t) parent,
+      (std::int16_t) (parent < 0 ? 0 : nodes[parent].depth + count)
+    };
+    return true;
+  }
+
+  /*
+    Record that dropping from node comes to rest at rest, if that is the
+    shortest way there so far.
+  */
+  void tetris_placements::tps_place(tetris_block rest, int node)
+  {
+    const tetris_symmetry &sym = TETROMINO_SYMMETRIES[rest.typ][rest.ori];
+    int key = reach_index(sym.ori, rest.loc.row + sym.drow);
+    int col = rest.loc.col + sym.dcol;
+    int length = nodes[node].depth + 1;
+    std::int16_t &slot = slots[key * MASK_COLS + col + MASK_COL_OFFSET];
+    if (!(placed[key] & reach_bit(col))) {
+      placed[key] |= reach_bit(col);
+      slot = num_placements++;
+    } else if (placements[slot].length <= length) {
+      return;
+    }
+    placements[slot] = {rest, node, length};
+  }
+
+  int tetris_placements::get_size() const
+  {
+    return num_placements;
+  }
+
+  const tetris_placement &tetris_placements::get_placement(int i) const
+  {
+    return placements[i];
+  }
+
+  int tetris_placements::get_path(int i, tetris_move *moves,
+                                   tetris_block *blocks) const
+  {
+    const tetris_placement &placement = placements[i];
+    int n, j, k = placement.length - 1;
+    moves[k] = TM_DROP;
+    if (blocks)
+      blocks[k] = placement.block;
+    for (n = placement.node; nodes[n].parent >= 0; n = nodes[n].parent) {
+      tetris_block block = nodes[n].tps_block(placement.block.typ);
+      for (j = 0; j < nodes[n].count; j++) {
+        moves[--k] = (tetris_move) nodes[n].move;
+        if (blocks) {
+          blocks[k] = block;
+          block.loc.row--;
+        }
+      }
+    }
+    return placement.length;
+  }
+
+  void tetris_game::tg_placements(tetris_block start,
+                                  tetris_placements &out) const
+  {
+    int c, head, seed, lateral, entry, depth, top = 0;
+
+    out.seen.fill(0);
+    out.placed.fill(0);
+    out.num_nodes = 0;
+    out.num_placements = 0;
+    if (!tg_fits(start))
+      return;
+    out.tps_visit(start, TM_NONE, 0, -1);
+
+    // Origins down to entry - 1 have an empty 4x4 box.  If the block starts in
+    // that open space, search its row with sideways moves and rotations only;
+    // every lateral state then enters row entry with a run of TM_NONE.
+    for (c = 0; c < cols; c++) {
+      top = MAX(top, heights[c]);
+    }
+    entry = rows - top - (TETRIS - 1);
+    lateral = 0;
+    if (start.loc.row >= 0 && start.loc.row < entry) {
+      for (head = 0; head < out.num_nodes; head++) {
+        tetris_block block = out.nodes[head].tps_block(start.typ);
+        tetris_block next = block;
+        next.loc.col--;
+        if (tg_fits(next))
+          out.tps_visit(next, TM_LEFT, 1, head);
+        next.loc.col += 2;
+        if (tg_fits(next))
+          out.tps_visit(next, TM_RIGHT, 1, head);
+        out.tps_visit(tg_rotated(block, 1), TM_CLOCK, 1, head);
+        out.tps_visit(tg_rotated(block, -1), TM_COUNTER, 1, head);
+        block.loc.row += tg_drop_distance(block);
+        out.tps_place(block, head);
+      }
+      lateral = out.num_nodes;
+    }
+
+    // Ordinary breadth-first search below, with the entries from the open space
+    // merged in by depth: before taking a node of depth d off the queue, add
+    // every entry of depth d + 1 or less.
+    seed = 0;
+    head = lateral;
+    while (head < out.num_nodes || seed < lateral) {
+      depth = head < out.num_nodes
+        ? out.nodes[head].depth + 1
+        : out.nodes[seed].depth + entry - start.loc.row;
+      for (; seed < lateral &&
+             out.nodes[seed].depth + entry - start.loc.row <= depth; seed++) {
+        tetris_block block = out.nodes[seed].tps_block(start.typ);
+        block.loc.row = entry;
+        if (tg_fits(block))
+          out.tps_visit(block, TM_NONE, entry - start.loc.row, seed);
+      }
+      if (head == out.num_nodes)
+        continue;
+
+      tetris_block block = out.nodes[head].tps_block(start.typ);
+      tetris_block next = block;
+      next.loc.row++;
+      if (tg_fits(next))
+        out.tps_visit(next, TM_NONE, 1, head);
+      next = block;
+      next.loc.col--;
+      if (tg_fits(next))
+        out.tps_visit(next, TM_LEFT, 1, head);
+      next.loc.col += 2;
+      if (tg_fits(next))
+        out.tps_visit(next, TM_RIGHT, 1, head);
+      out.tps_visit(tg_rotated(block, 1), TM_CLOCK, 1, head);
+      out.tps_visit(tg_rotated(block, -1), TM_COUNTER, 1, head);
+      block.loc.row += tg_drop_distance(block);
+      out.tps_place(block, head);
+      head++;
+    }
+  }
+}
@@ -0,0 +1,105 @@
+/***************************************************************************//**
+
+  @file         tetris_placement.hpp
+
+  @brief        Every place a falling block can come to rest.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_game.hpp"
+#include <array>
+#include <cstdint>
+
+namespace tetris{
+
+  /*
+    Block origins that can fit on some board: a row from -(TETRIS - 1) up to
+    MAX_ROWS - 1 and a column over the same range as TETROMINO_MASKS.
+  */
+  constexpr int REACH_ROW_OFFSET = TETRIS - 1;
+  constexpr int REACH_ROWS = MAX_ROWS + REACH_ROW_OFFSET;
+  constexpr int MAX_REACH = NUM_ORIENTATIONS * REACH_ROWS * MASK_COLS;
+
+  /*
+    One reachable resting place.  block is where the piece locks; length is the
+    number of inputs in its path, the last of which is TM_DROP.
+  */
+  struct tetris_placement {
+    tetris_block block;
+    int node;
+    int length;
+  };
+
+  /*
+    The result of tg_placements: a breadth-first search over (orientation, row,
+    column) from the starting block, where the moves are TM_LEFT, TM_RIGHT,
+    TM_CLOCK, TM_COUNTER (with tg_rotate's wall kicks) and TM_NONE, meaning
+    "wait for gravity to move the block down one row".  Every state is dropped
+    with TM_DROP, and each resting place keeps the shortest path that ends
+    there.  Orientations that cover the same cells (all of O, and the two
+    horizontal or vertical states of I, S and Z) count as one place.
+
+    Rows whose whole 4x4 box is above the stack are all alike, so the search
+    only walks the starting row of that open space and enters the rows below
+    it straight from there, instead of visiting every open row.
+
+    The paths assume gravity only acts on TM_NONE, so a bot should replay them
+    feeding TM_NONE until the block moves down and every other input as soon as
+    it can.  The object is big (tens of kilobytes) and meant to be reused from
+    call to call; nothing is allocated while searching.
+  */
+  class tetris_placements {
+
+    friend class tetris_game;
+
+    private:
+      /*
+        A search state.  It is reached from parent by count repeats of move.
+      */
+      struct node {
+        std::int8_t ori, row, col, move, count;
+        std::int16_t parent;
+        std::int16_t depth;
+
+        tetris_block tps_block(int typ) const
+        {
+          return tetris_block{typ, ori, {row, col}};
+        }
+      };
+
+      /*
+        Bit (col + MASK_COL_OFFSET) of seen[ori * REACH_ROWS + row +
+        REACH_ROW_OFFSET] is set once a state is queued.  placed is the same for
+        resting places, indexed by their first symmetric orientation, and slots
+        holds the index of each of those in placements.
+      */
+      std::array<tetris_row, NUM_ORIENTATIONS * REACH_ROWS> seen;
+      std::array<tetris_row, NUM_ORIENTATIONS * REACH_ROWS> placed;
+      std::array<std::int16_t, MAX_REACH> slots;
+      std::array<node, MAX_REACH> nodes;
+      std::array<tetris_placement, MAX_REACH> placements;
+      int num_nodes;
+      int num_placements;
+
+      bool tps_visit(tetris_block block, tetris_move move, int count, int parent);
+      void tps_place(tetris_block rest, int node);
+
+    public:
+      /*
+        Number of distinct placements, and placement i (in no particular order).
+      */
+      int get_size() const;
+      const tetris_placement &get_placement(int i) const;
+      /*
+        Write the inputs leading to placement i into moves, which must have room
+        for get_placement(i).length of them, and if blocks isn't null, where the
+        block should be after each one.  Returns the length.
+      */
+      int get_path(int i, tetris_move *moves,
+                   tetris_block *blocks = nullptr) const;
+  };
+}
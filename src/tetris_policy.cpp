@@ -0,0 +1,141 @@
+/***************************************************************************//**
+
+  @file         tetris_policy.cpp
+
+  @brief        Move policies for driving headless games.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_policy.hpp"
+#include <climits>
+
+namespace tetris{
+
+  tetris_move idle_policy::choose(const tetris_game &tg)
+  {
+    (void) tg;
+    return TM_NONE;
+  }
+
+  long idle_policy::wait(const tetris_game &tg)
+  {
+    (void) tg;
+    return LONG_MAX;
+  }
+
+  random_policy::random_policy(std::uint64_t seed) : state(seed) {}
+
+  tetris_move random_policy::choose(const tetris_game &tg)
+  {
+    (void) tg;
+    // 64-bit LCG; the high bits are plenty random for picking keys.
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    unsigned r = state >> 33;
+    if (r % 8 != 0)
+      return TM_NONE;
+    return (tetris_move) ((r >> 3) % TM_NONE);
+  }
+
+  void random_policy::reset(std::uint64_t seed)
+  {
+    state = seed;
+  }
+
+  static bool same_block(tetris_block a, tetris_block b)
+  {
+    return a.typ == b.typ && a.ori == b.ori && a.loc.row == b.loc.row &&
+           a.loc.col == b.loc.col;
+  }
+
+  ai_policy::ai_policy(const tetris_ai_config &config)
+    : ai(config), step(0), expect{-1, 0, {0, 0}} {}
+
+  /*
+    Search for the falling block and start following the best path.
+  */
+  bool ai_policy::ap_plan(const tetris_game &tg)
+  {
+    int best = ai.tai_search(tg);
+    step = 0;
+    expect = tg.get_falling();
+    if (best < 0) {
+      moves.clear();
+      return false;
+    }
+    moves.resize(ai.get_root().get_placement(best).length);
+    blocks.resize(moves.size());
+    ai.get_root().get_path(best, moves.data(), blocks.data());
+    return true;
+  }
+
+  tetris_move ai_policy::choose(const tetris_game &tg)
+  {
+    tetris_block falling = tg.get_falling();
+    int n = moves.size();
+    // A wait is over once gravity has moved the block down.
+    while (step < n && moves[step] == TM_NONE &&
+           same_block(falling, blocks[step])) {
+      expect = blocks[step++];
+    }
+    if (step >= n || !same_block(falling, expect)) {
+      if (!ap_plan(tg))
+        return TM_NONE;
+    }
+    if (moves[step] == TM_NONE)
+      return TM_NONE;
+    expect = blocks[step];
+    return moves[step++];
+  }
+
+  /*
+    While the block waits for gravity at a TM_NONE step of the path, choose
+    returns TM_NONE and leaves everything alone until the block moves.
+  */
+  long ai_policy::wait(const tetris_game &tg)
+  {
+    tetris_block falling = tg.get_falling();
+    if (step < (int) moves.size() && moves[step] == TM_NONE &&
+        same_block(falling, expect) && !same_block(falling, blocks[step]))
+      return LONG_MAX;
+    return 0;
+  }
+
+  /*
+    Forget the last game's plan.
+  */
+  void ai_policy::reset(std::uint64_t seed)
+  {
+    (void) seed;
+    moves.clear();
+    blocks.clear();
+    step = 0;
+    expect = tetris_block{-1, 0, {0, 0}};
+  }
+
+  long ai_policy::get_nodes() const
+  {
+    return ai.get_stats().nodes;
+  }
+
+  tetris_policy_factory tp_factory(const std::string &name,
+                                   const tetris_ai_config &config)
+  {
+    if (name == "idle") {
+      return [] { return std::unique_ptr<tetris_policy>(new idle_policy); };
+    }
+    if (name == "random") {
+      // Reseeded for every game by reset.
+      return [] {
+        return std::unique_ptr<tetris_policy>(new random_policy(0));
+      };
+    }
+    if (name == "beam") {
+      return [config] {
+        return std::unique_ptr<tetris_policy>(new ai_policy(config));
+      };
+    }
+    return tetris_policy_factory();
+  }
+}
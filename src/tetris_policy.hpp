@@ -0,0 +1,107 @@
+/***************************************************************************//**
+
+  @file         tetris_policy.hpp
+
+  @brief        Move policies for driving headless games.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_ai.hpp"
+#include "tetris_game.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tetris{
+
+  /*
+    Something that picks the move for each tick of a game.  A policy object is
+    only ever used by one thread at a time, so it may keep state.
+  */
+  class tetris_policy {
+    public:
+      virtual ~tetris_policy() {}
+      virtual tetris_move choose(const tetris_game &tg) = 0;
+      /*
+        Start a new game, which is seeded with seed.  A policy with randomness
+        of its own reseeds from it, so that the game plays out the same
+        whichever thread, after whichever other games, plays it.
+      */
+      virtual void reset(std::uint64_t seed) { (void) seed; }
+      /*
+        How many ticks from now choose is sure to return TM_NONE, unless
+        gravity moves the falling block first, without changing the policy.
+        Those ticks may be played with tg_advance without asking.
+      */
+      virtual long wait(const tetris_game &tg) { (void) tg; return 0; }
+      /*
+        Search nodes visited so far, for policies that search.
+      */
+      virtual long get_nodes() const { return 0; }
+  };
+
+  /*
+    Makes a fresh policy, e.g. one per worker thread.
+  */
+  typedef std::function<std::unique_ptr<tetris_policy>()> tetris_policy_factory;
+
+  /*
+    Never presses anything; blocks just fall.
+  */
+  class idle_policy : public tetris_policy {
+    public:
+      tetris_move choose(const tetris_game &tg) override;
+      long wait(const tetris_game &tg) override;
+  };
+
+  /*
+    Presses a random key on a fraction of ticks, like a player mashing keys.
+  */
+  class random_policy : public tetris_policy {
+    private:
+      std::uint64_t state;
+    public:
+      explicit random_policy(std::uint64_t seed);
+      tetris_move choose(const tetris_game &tg) override;
+      void reset(std::uint64_t seed) override;
+  };
+
+  /*
+    Plays the moves found by tetris_ai.  Each new piece gets a search, and the
+    path to the chosen place is fed in one input per tick, waiting out the
+    TM_NONE steps for gravity.  If the block ever isn't where the path expects
+    (gravity struck between two inputs, say) it searches again from there.
+  */
+  class ai_policy : public tetris_policy {
+    private:
+      tetris_ai ai;
+      std::vector<tetris_move> moves;
+      std::vector<tetris_block> blocks;
+      int step;
+      tetris_block expect;
+
+      bool ap_plan(const tetris_game &tg);
+
+    public:
+      explicit ai_policy(const tetris_ai_config &config);
+      tetris_move choose(const tetris_game &tg) override;
+      void reset(std::uint64_t seed) override;
+      long wait(const tetris_game &tg) override;
+      long get_nodes() const override;
+  };
+
+  /*
+    Return a factory for the policy with the given name ("idle", "random" or
+    "beam", the last set up by config), or an empty one if there is no such
+    policy.
+  */
+  tetris_policy_factory tp_factory(const std::string &name,
+                                   const tetris_ai_config &config =
+                                     tetris_ai_config());
+}
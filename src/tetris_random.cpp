@@ -0,0 +1,135 @@
+/***************************************************************************//**
+
+  @file         tetris_random.cpp
+
+  @brief        Per-game piece generator.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_random.hpp"
+#include "tetris_game.hpp"
+
+namespace tetris{
+
+  constexpr std::uint64_t PCG_MULTIPLIER = 6364136223846793005ULL;
+  constexpr std::uint64_t PCG_INCREMENT = 1442695040888963407ULL;
+  constexpr unsigned QUEUE_MASK = 15;
+
+  static_assert(NUM_PREVIEW + NUM_TETROMINOS + 1 <= QUEUE_MASK + 1,
+                "the queue must hold a full preview plus one batch");
+  static_assert(MAX_QUEUED == NUM_PREVIEW + NUM_TETROMINOS,
+                "MAX_QUEUED counts one batch of every tetromino");
+
+  tetris_pieces::tetris_pieces(std::uint64_t seed, tetris_randomizer randomizer)
+  {
+    this->randomizer = randomizer;
+    head = 0;
+    count = 0;
+    queue.fill(0);
+    // Standard PCG32 seeding.
+    state = 0;
+    tp_random();
+    state += seed;
+    tp_random();
+    tp_refill();
+  }
+
+  /*
+    PCG32 (XSH RR): 64 bits of state, 32 bits out.
+  */
+  std::uint32_t tetris_pieces::tp_random()
+  {
+    std::uint64_t old = state;
+    state = old * PCG_MULTIPLIER + PCG_INCREMENT;
+    std::uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+    std::uint32_t rot = old >> 59;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+  }
+
+  /*
+    Return a number in [0, bound).
+  */
+  int tetris_pieces::tp_below(int bound)
+  {
+    return (std::uint64_t(tp_random()) * bound) >> 32;
+  }
+
+  /*
+    Append one batch of NUM_TETROMINOS pieces to the queue.
+  */
+  void tetris_pieces::tp_refill()
+  {
+    std::uint8_t batch[NUM_TETROMINOS];
+    int i, j;
+    if (randomizer == TR_BAG) {
+      for (i = 0; i < NUM_TETROMINOS; i++) {
+        batch[i] = i;
+      }
+      for (i = NUM_TETROMINOS - 1; i > 0; i--) {
+        j = tp_below(i + 1);
+        std::uint8_t t = batch[i];
+        batch[i] = batch[j];
+        batch[j] = t;
+      }
+    } else {
+      for (i = 0; i < NUM_TETROMINOS; i++) {
+        batch[i] = tp_below(NUM_TETROMINOS);
+      }
+    }
+    for (i = 0; i < NUM_TETROMINOS; i++) {
+      queue[(head + count++) & QUEUE_MASK] = batch[i];
+    }
+  }
+
+  int tetris_pieces::tp_pop()
+  {
+    int piece = queue[head];
+    head = (head + 1) & QUEUE_MASK;
+    count--;
+    if (count <= NUM_PREVIEW)
+      tp_refill();
+    return piece;
+  }
+
+  int tetris_pieces::tp_peek(int i) const
+  {
+    return queue[(head + i) & QUEUE_MASK];
+  }
+
+  tetris_randomizer tetris_pieces::get_randomizer() const
+  {
+    return (tetris_randomizer) randomizer;
+  }
+
+  std::uint64_t tetris_pieces::get_state() const
+  {
+    return state;
+  }
+
+  int tetris_pieces::get_count() const
+  {
+    return count;
+  }
+
+  int tetris_pieces::get_queued(int i) const
+  {
+    return queue[(head + i) & QUEUE_MASK];
+  }
+
+  void tetris_pieces::tp_restore(std::uint64_t state,
+                                 tetris_randomizer randomizer,
+                                 const std::uint8_t *queued, int count)
+  {
+    int i;
+    this->state = state;
+    this->randomizer = randomizer;
+    this->head = 0;
+    this->count = count;
+    queue.fill(0);
+    for (i = 0; i < count; i++) {
+      queue[i] = queued[i];
+    }
+  }
+}
@@ -0,0 +1,84 @@
+/***************************************************************************//**
+
+  @file         tetris_random.hpp
+
+  @brief        Per-game piece generator.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include <array>
+#include <cstdint>
+
+namespace tetris{
+
+  /*
+    How pieces are picked: independently at random, or by dealing out shuffled
+    bags holding one of each tetromino.
+  */
+  enum tetris_randomizer{
+    TR_UNIFORM, TR_BAG
+  };
+
+  /*
+    How many pieces after the next one a game can see.
+  */
+  constexpr unsigned short NUM_PREVIEW = 5;
+
+  /*
+    Most pieces ever queued.  A batch of seven is only added once NUM_PREVIEW or
+    fewer are left.
+  */
+  constexpr unsigned short MAX_QUEUED = NUM_PREVIEW + 7;
+
+  /*
+    The upcoming pieces of one game, with the generator that makes them.  The
+    generator is a PCG32 owned by the game, so games never share state and the
+    whole sequence follows from the seed.  Pieces are made seven at a time (one
+    bag, in bag mode) whenever fewer than NUM_PREVIEW are left after a pop.
+  */
+  class tetris_pieces {
+
+    private:
+      std::uint64_t state;
+      std::uint8_t randomizer;
+      std::uint8_t head;
+      std::uint8_t count;
+      std::array<std::uint8_t, 16> queue;
+
+      std::uint32_t tp_random();
+      int tp_below(int bound);
+      void tp_refill();
+
+    public:
+      /*
+        The default constructor leaves the generator unset, to be assigned.
+      */
+      tetris_pieces() = default;
+      tetris_pieces(std::uint64_t seed, tetris_randomizer randomizer);
+
+      /*
+        Take the next piece off the queue.
+      */
+      int tp_pop();
+      /*
+        Look at the piece tp_pop would return i pops from now, for
+        0 <= i < NUM_PREVIEW: tp_peek(0) is the one it returns next.
+      */
+      int tp_peek(int i) const;
+      tetris_randomizer get_randomizer() const;
+
+      /*
+        The generator state and the queued pieces, the one tp_pop returns next
+        first, for saving a game.  tp_restore puts them back.
+      */
+      std::uint64_t get_state() const;
+      int get_count() const;
+      int get_queued(int i) const;
+      void tp_restore(std::uint64_t state, tetris_randomizer randomizer,
+                      const std::uint8_t *queued, int count);
+  };
+}
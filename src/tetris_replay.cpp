@@ -0,0 +1,383 @@
+/***************************************************************************//**
+
+  @file         tetris_replay.cpp
+
+  @brief        Record the moves of a game and play them back.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_replay.hpp"
+#include "tetris_packed.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace tetris{
+
+  static_assert(TM_NONE < REPLAY_KEYFRAME,
+                "every move fits in REPLAY_MOVE_BITS, short of a keyframe");
+
+  /*******************************************************************************
+
+                                    Recorder
+
+  *******************************************************************************/
+
+  tetris_recorder::tetris_recorder()
+    : f(nullptr), written(0), move(-1), run(0), ticks(0), interval(0),
+      ok(false)
+  {
+  }
+
+  tetris_recorder::~tetris_recorder()
+  {
+    trc_close();
+  }
+
+  bool tetris_recorder::trc_open(const char *path, const tetris_game &game,
+                                 std::uint64_t interval)
+  {
+    std::uint8_t header[REPLAY_HEADER_BYTES] = {0};
+
+    trc_close();
+    f = fopen(path, "wb");
+    if (!f)
+      return false;
+    std::memcpy(header, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    store_le(header + 8, REPLAY_VERSION, 4);
+    store_le(header + 12, game.get_rows(), 2);
+    store_le(header + 14, game.get_cols(), 2);
+    store_le(header + 16, game.get_randomizer(), 1);
+    store_le(header + 24, game.get_seed(), 8);
+    buffer.assign(header, header + sizeof(header));
+    buffer.reserve(REPLAY_BUFFER_BYTES);
+    index.clear();
+    written = 0;
+    move = -1;
+    run = 0;
+    ticks = 0;
+    this->interval = interval;
+    ok = true;
+    return true;
+  }
+
+  /*
+    Append value to the buffer as a varint, seven bits a byte, lowest first.
+  */
+  void tetris_recorder::trc_put(std::uint64_t value)
+  {
+    for (; value >= 0x80; value >>= 7) {
+      buffer.push_back((std::uint8_t) (value | 0x80));
+    }
+    buffer.push_back((std::uint8_t) value);
+    if (buffer.size() + 10 > REPLAY_BUFFER_BYTES)
+      trc_write();
+  }
+
+  void tetris_recorder::trc_end_run()
+  {
+    if (run > 0)
+      trc_put(run << REPLAY_MOVE_BITS | move);
+    run = 0;
+  }
+
+  /*
+    Add a keyframe of game, ending the run before it.  Games too big to pack
+    just go without.
+  */
+  void tetris_recorder::trc_keyframe(const tetris_game &game)
+  {
+    tetris_packed packed;
+    if (!game.tg_pack(packed))
+      return;
+    trc_end_run();
+    move = -1;
+    index.push_back(tetris_keyframe{ticks, written + buffer.size()});
+    trc_put(REPLAY_KEYFRAME);
+    buffer.insert(buffer.end(), packed.bytes.begin(), packed.bytes.end());
+  }
+
+  void tetris_recorder::trc_write()
+  {
+    if (!buffer.empty() && fwrite(buffer.data(), buffer.size(), 1, f) != 1)
+      ok = false;
+    written += buffer.size();
+    buffer.clear();
+  }
+
+  void tetris_recorder::trc_record(const tetris_game &game, tetris_move move,
+                                   std::uint64_t count)
+  {
+    if (!f || count == 0)
+      return;
+    ticks += count;
+    if (move == this->move) {
+      run += count;
+    } else {
+      trc_end_run();
+      this->move = move;
+      run = count;
+    }
+    if (interval && ticks % interval == 0)
+      trc_keyframe(game);
+  }
+
+  std::uint64_t tetris_recorder::trc_span() const
+  {
+    if (!f || !interval)
+      return UINT64_MAX;
+    return interval - ticks % interval;
+  }
+
+  bool tetris_recorder::trc_close()
+  {
+    std::uint8_t word[8];
+    if (!f)
+      return false;
+    trc_end_run();
+    trc_put(0);
+
+    std::uint64_t start = written + buffer.size();
+    for (const tetris_keyframe &k : index) {
+      store_le(word, k.tick, 8);
+      buffer.insert(buffer.end(), word, word + 8);
+      store_le(word, k.offset, 8);
+      buffer.insert(buffer.end(), word, word + 8);
+      if (buffer.size() + 16 > REPLAY_BUFFER_BYTES)
+        trc_write();
+    }
+    store_le(word, index.size(), 8);
+    buffer.insert(buffer.end(), word, word + 8);
+    store_le(word, start, 8);
+    buffer.insert(buffer.end(), word, word + 8);
+    buffer.insert(buffer.end(), REPLAY_INDEX_MAGIC,
+                  REPLAY_INDEX_MAGIC + sizeof(REPLAY_INDEX_MAGIC));
+    trc_write();
+    ok = fclose(f) == 0 && ok;
+    f = nullptr;
+    return ok;
+  }
+
+  std::uint64_t tetris_recorder::get_ticks() const
+  {
+    return ticks;
+  }
+
+  /*******************************************************************************
+
+                                    Replayer
+
+  *******************************************************************************/
+
+  tetris_replay::tetris_replay()
+    : f(nullptr), pos(0), end(0), rows(0), cols(0), seed(0),
+      randomizer(TR_UNIFORM), move(0), run(0), tick(0)
+  {
+  }
+
+  tetris_replay::~tetris_replay()
+  {
+    trp_close();
+  }
+
+  bool tetris_replay::trp_open(const char *path)
+  {
+    std::uint8_t header[REPLAY_HEADER_BYTES];
+
+    trp_close();
+    f = fopen(path, "rb");
+    if (!f)
+      return false;
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+        std::memcmp(header, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) != 0 ||
+        load_le(header + 8, 4) == 0 ||
+        load_le(header + 8, 4) > REPLAY_VERSION) {
+      trp_close();
+      return false;
+    }
+    rows = load_le(header + 12, 2);
+    cols = load_le(header + 14, 2);
+    randomizer = (tetris_randomizer) load_le(header + 16, 1);
+    seed = load_le(header + 24, 8);
+    if (!tg_valid_size(rows, cols)) {
+      trp_close();
+      return false;
+    }
+    buffer.resize(REPLAY_BUFFER_BYTES);
+    trp_read_index();
+    if (!trp_rewind(REPLAY_HEADER_BYTES)) {
+      trp_close();
+      return false;
+    }
+    tick = 0;
+    return true;
+  }
+
+  /*
+    Load the seek index, if the file has one.
+  */
+  void tetris_replay::trp_read_index()
+  {
+    std::uint8_t trailer[REPLAY_TRAILER_BYTES], entry[16];
+    std::uint64_t count, start, i;
+    index.clear();
+    if (fseek(f, -(long) REPLAY_TRAILER_BYTES, SEEK_END) != 0 ||
+        fread(trailer, sizeof(trailer), 1, f) != 1 ||
+        std::memcmp(trailer + 16, REPLAY_INDEX_MAGIC,
+                    sizeof(REPLAY_INDEX_MAGIC)) != 0)
+      return;
+    count = load_le(trailer, 8);
+    start = load_le(trailer + 8, 8);
+    if (fseek(f, start, SEEK_SET) != 0)
+      return;
+    for (i = 0; i < count; i++) {
+      if (fread(entry, sizeof(entry), 1, f) != 1) {
+        index.clear();
+        return;
+      }
+      index.push_back(tetris_keyframe{load_le(entry, 8), load_le(entry + 8, 8)});
+    }
+  }
+
+  void tetris_replay::trp_close()
+  {
+    if (f)
+      fclose(f);
+    f = nullptr;
+    index.clear();
+    pos = end = 0;
+    run = 0;
+    tick = 0;
+  }
+
+  tetris_game tetris_replay::get_start() const
+  {
+    return tetris_game(rows, cols, seed, randomizer);
+  }
+
+  std::uint64_t tetris_replay::get_tick() const
+  {
+    return tick;
+  }
+
+  const std::vector<tetris_keyframe> &tetris_replay::get_index() const
+  {
+    return index;
+  }
+
+  bool tetris_replay::trp_byte(std::uint8_t &byte)
+  {
+    if (pos == end) {
+      if (!f)
+        return false;
+      pos = 0;
+      end = fread(buffer.data(), 1, buffer.size(), f);
+      if (end == 0)
+        return false;
+    }
+    byte = buffer[pos++];
+    return true;
+  }
+
+  bool tetris_replay::trp_get(std::uint64_t &value)
+  {
+    std::uint8_t byte;
+    int shift;
+    value = 0;
+    for (shift = 0; shift < 64; shift += 7) {
+      if (!trp_byte(byte))
+        return false;
+      value |= std::uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  bool tetris_replay::trp_skip(std::size_t bytes)
+  {
+    std::uint8_t byte;
+    for (; bytes > 0; bytes--) {
+      if (!trp_byte(byte))
+        return false;
+    }
+    return true;
+  }
+
+  /*
+    Continue reading from offset, with no run under way.
+  */
+  bool tetris_replay::trp_rewind(std::uint64_t offset)
+  {
+    pos = end = 0;
+    run = 0;
+    return f && fseek(f, offset, SEEK_SET) == 0;
+  }
+
+  bool tetris_replay::trp_next(tetris_move &move)
+  {
+    std::uint64_t value;
+    while (run == 0) {
+      if (!trp_get(value) || value == 0)
+        return false;
+      if (value == REPLAY_KEYFRAME) {
+        if (!trp_skip(PACKED_BYTES))
+          return false;
+        continue;
+      }
+      this->move = value & REPLAY_KEYFRAME;
+      run = value >> REPLAY_MOVE_BITS;
+    }
+    move = (tetris_move) this->move;
+    run--;
+    tick++;
+    return true;
+  }
+
+  std::uint64_t tetris_replay::trp_play(tetris_game &game, std::uint64_t ticks)
+  {
+    std::uint64_t played = 0, i, n;
+    tetris_move move;
+    while (played < ticks && trp_next(move)) {
+      // trp_next took the first tick of the run; take the rest of it together.
+      n = run + 1 < ticks - played ? run + 1 : ticks - played;
+      run -= n - 1;
+      tick += n - 1;
+      for (i = 0; i < n; i++) {
+        game.tg_tick(move);
+      }
+      played += n;
+    }
+    return played;
+  }
+
+  bool tetris_replay::trp_seek(std::uint64_t tick, tetris_game &game)
+  {
+    std::uint64_t value;
+    tetris_packed packed;
+    auto k = std::upper_bound(index.begin(), index.end(), tick,
+                              [](std::uint64_t t, const tetris_keyframe &k) {
+                                return t < k.tick;
+                              });
+    bool found = false, whole = true;
+
+    // Start from the keyframe if it reads back, or else from the beginning.
+    if (k != index.begin() && trp_rewind((k - 1)->offset) &&
+        trp_get(value) && value == REPLAY_KEYFRAME) {
+      for (std::uint8_t &byte : packed.bytes) {
+        whole = whole && trp_byte(byte);
+      }
+      found = whole && game.tg_unpack(packed);
+    }
+    if (found) {
+      this->tick = (k - 1)->tick;
+    } else {
+      trp_rewind(REPLAY_HEADER_BYTES);
+      this->tick = 0;
+      game = get_start();
+    }
+    std::uint64_t remaining = tick - this->tick;
+    return trp_play(game, remaining) == remaining;
+  }
+}
@@ -0,0 +1,194 @@
+/***************************************************************************//**
+
+  @file         tetris_replay.hpp
+
+  @brief        Record the moves of a game and play them back.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_game.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace tetris{
+
+  /*
+    A replay file is a header of REPLAY_HEADER_BYTES, little-endian at fixed
+    offsets,
+
+      offset  bytes  field
+           0      8  REPLAY_MAGIC
+           8      4  version, REPLAY_VERSION
+          12      2  rows
+          14      2  cols
+          16      1  randomizer
+          17      7  zero
+          24      8  seed
+
+    then the move given to each tg_tick, run-length encoded.  A run of count
+    ticks of the same move is the LEB128 varint (count << 3 | move), count >= 1.
+    The game is recreated from the header, so replaying the runs gives back
+    exactly the recorded game.  A zero ends the stream; a file cut short ends
+    after its last whole run.
+
+    Every so often the stream holds a keyframe instead of a run: the varint
+    REPLAY_KEYFRAME followed by the game packed (tetris_packed.hpp) as it was
+    after all the ticks before it.  After the end of the stream comes the seek
+    index, a (tick, file offset) pair of 8-byte words for each keyframe, and
+    then a REPLAY_TRAILER_BYTES trailer at the very end of the file:
+
+      offset  bytes  field
+           0      8  number of keyframes
+           8      8  file offset of the seek index
+          16      8  REPLAY_INDEX_MAGIC
+
+    A file without the trailer (cut short, or version 1) still plays; seeking
+    in it starts from the beginning.
+  */
+  constexpr char REPLAY_MAGIC[8] = {'T', 'E', 'T', 'R', 'I', 'S', 'R', 'P'};
+  constexpr char REPLAY_INDEX_MAGIC[8] = {'T', 'E', 'T', 'R', 'I', 'S', 'I',
+                                          'X'};
+  constexpr std::uint32_t REPLAY_VERSION = 2;
+  constexpr std::size_t REPLAY_HEADER_BYTES = 32;
+  constexpr std::size_t REPLAY_TRAILER_BYTES = 24;
+  constexpr int REPLAY_MOVE_BITS = 3;
+  constexpr std::uint64_t REPLAY_KEYFRAME = (1 << REPLAY_MOVE_BITS) - 1;
+
+  constexpr std::size_t REPLAY_BUFFER_BYTES = 1 << 16;
+  /*
+    Default ticks between keyframes.  Seeking replays at most this many ticks,
+    a millisecond or two of engine time.
+  */
+  constexpr std::uint64_t REPLAY_KEYFRAME_TICKS = 1 << 14;
+
+  struct tetris_keyframe {
+    std::uint64_t tick;
+    std::uint64_t offset;
+  };
+
+  /*
+    Writes a replay while a game is played.  Runs are built up in memory and
+    written out REPLAY_BUFFER_BYTES at a time, so recording costs a compare
+    and an increment on most ticks.
+  */
+  class tetris_recorder {
+
+    private:
+      FILE *f;
+      std::vector<std::uint8_t> buffer;
+      std::vector<tetris_keyframe> index;
+      /*
+        Bytes already written to f.
+      */
+      std::uint64_t written;
+      /*
+        The move repeated by the run being counted, or -1 before the first.
+      */
+      int move;
+      std::uint64_t run;
+      std::uint64_t ticks;
+      std::uint64_t interval;
+      bool ok;
+
+      void trc_put(std::uint64_t value);
+      void trc_end_run();
+      void trc_keyframe(const tetris_game &game);
+      void trc_write();
+
+    public:
+      tetris_recorder();
+      ~tetris_recorder();
+      tetris_recorder(const tetris_recorder &) = delete;
+      tetris_recorder &operator=(const tetris_recorder &) = delete;
+
+      /*
+        Start recording game, which must not have been ticked yet, to path,
+        with a keyframe every interval ticks (0 for none).
+      */
+      bool trc_open(const char *path, const tetris_game &game,
+                    std::uint64_t interval = REPLAY_KEYFRAME_TICKS);
+      /*
+        Record that move was just passed to tg_tick count times, leaving game
+        as it is now.  Does nothing when no file is open.
+      */
+      void trc_record(const tetris_game &game, tetris_move move,
+                      std::uint64_t count = 1);
+      /*
+        Most ticks the next trc_record may cover, so that keyframes fall on
+        their interval.
+      */
+      std::uint64_t trc_span() const;
+      /*
+        Finish the file.  False if it was never opened or any write failed.
+      */
+      bool trc_close();
+      std::uint64_t get_ticks() const;
+  };
+
+  /*
+    Reads a replay back one move at a time.
+  */
+  class tetris_replay {
+
+    private:
+      FILE *f;
+      std::vector<std::uint8_t> buffer;
+      std::vector<tetris_keyframe> index;
+      std::size_t pos;
+      std::size_t end;
+      int rows;
+      int cols;
+      std::uint64_t seed;
+      tetris_randomizer randomizer;
+      int move;
+      std::uint64_t run;
+      std::uint64_t tick;
+
+      bool trp_byte(std::uint8_t &byte);
+      bool trp_get(std::uint64_t &value);
+      bool trp_skip(std::size_t bytes);
+      bool trp_rewind(std::uint64_t offset);
+      void trp_read_index();
+
+    public:
+      tetris_replay();
+      ~tetris_replay();
+      tetris_replay(const tetris_replay &) = delete;
+      tetris_replay &operator=(const tetris_replay &) = delete;
+
+      bool trp_open(const char *path);
+      void trp_close();
+      /*
+        The game as it was when recording started.
+      */
+      tetris_game get_start() const;
+      /*
+        Ticks read so far.
+      */
+      std::uint64_t get_tick() const;
+      /*
+        The keyframes in the seek index, by tick.
+      */
+      const std::vector<tetris_keyframe> &get_index() const;
+      /*
+        The next recorded move, or false at the end of the replay.
+      */
+      bool trp_next(tetris_move &move);
+      /*
+        Tick game, which is at get_tick(), through up to ticks more recorded
+        moves, a run at a time.  Returns how many were played.
+      */
+      std::uint64_t trp_play(tetris_game &game, std::uint64_t ticks);
+      /*
+        Set game to how it was after tick ticks, starting from the last
+        keyframe at or before it.  False if the replay is shorter than that;
+        game is then left at its end.
+      */
+      bool trp_seek(std::uint64_t tick, tetris_game &game);
+  };
+}
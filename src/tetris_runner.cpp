@@ -0,0 +1,179 @@
+/***************************************************************************//**
+
+  @file         tetris_runner.cpp
+
+  @brief        Play many headless games across all cores.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_runner.hpp"
+#include "tetris_replay.hpp"
+#include "tetris_trace.hpp"
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tetris{
+
+  #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+  double tetris_run_stats::games_per_sec() const
+  {
+    return seconds > 0 ? games / seconds : 0;
+  }
+
+  double tetris_run_stats::ticks_per_sec() const
+  {
+    return seconds > 0 ? ticks / seconds : 0;
+  }
+
+  double tetris_run_stats::nodes_per_sec() const
+  {
+    return seconds > 0 ? nodes / seconds : 0;
+  }
+
+  /*
+    A worker's queue of game numbers.  The owner works from the back, thieves
+    take from the front, so the two rarely want the same end.
+  */
+  struct work_queue {
+    std::mutex lock;
+    std::deque<int> games;
+
+    bool pop(int &game)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (games.empty())
+        return false;
+      game = games.back();
+      games.pop_back();
+      return true;
+    }
+
+    bool steal(int &game)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (games.empty())
+        return false;
+      game = games.front();
+      games.pop_front();
+      return true;
+    }
+  };
+
+  /*
+    Play game number game to the end and add it to stats.
+  */
+  static void play(const tetris_run_config &config, int game,
+                   tetris_policy &policy, tetris_run_stats &stats)
+  {
+    tetris_game tg(config.rows, config.cols, config.seed + game,
+                   config.randomizer);
+    tetris_recorder recorder;
+    tetris_move move;
+    long ticks = 0;
+    bool running = true;
+    TRACE_SPAN("game");
+    policy.reset(config.seed + game);
+    if (!config.replays.empty()) {
+      std::string path = config.replays + "/game-" + std::to_string(game) +
+        ".replay";
+      if (!recorder.trc_open(path.c_str(), tg))
+        fprintf(stderr, "can't record %s\n", path.c_str());
+    }
+    while (running && ticks < config.max_ticks) {
+      long wait = config.warp ? policy.wait(tg) : 0;
+      if (wait > 0) {
+        // Skip to the next gravity event, or as far as the policy, the tick
+        // limit and the next keyframe allow.
+        wait = MIN(wait, config.max_ticks - ticks);
+        wait = MIN(wait, (long) MIN(recorder.trc_span(),
+                                    (std::uint64_t) LONG_MAX));
+        wait = tg.tg_advance(wait, running);
+        recorder.trc_record(tg, TM_NONE, wait);
+        ticks += wait;
+        continue;
+      }
+      {
+        TRACE_SPAN("choose");
+        move = policy.choose(tg);
+      }
+      running = tg.tg_tick(move);
+      recorder.trc_record(tg, move);
+      ticks++;
+    }
+    stats.games++;
+    stats.ticks += ticks;
+    stats.points += tg.get_points();
+    stats.capped += running;
+  }
+
+  tetris_run_stats tr_run(const tetris_run_config &config,
+                          const tetris_policy_factory &factory)
+  {
+    int nthreads = config.threads > 0 ? config.threads
+                                      : std::thread::hardware_concurrency();
+    nthreads = nthreads > 0 ? nthreads : 1;
+    std::vector<work_queue> queues(nthreads);
+    std::vector<tetris_run_stats> results(nthreads);
+    std::vector<std::thread> workers;
+    int i;
+
+    for (i = 0; i < config.games; i++) {
+      queues[i % nthreads].games.push_back(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (i = 0; i < nthreads; i++) {
+      workers.emplace_back([&, i] {
+        std::unique_ptr<tetris_policy> policy = factory();
+        tetris_run_stats &stats = results[i];
+        tetris_perf_counters counters;
+        int game, victim;
+        TRACE_THREAD(("worker " + std::to_string(i)).c_str());
+        if (config.counters && counters.tpc_open())
+          counters.tpc_start();
+        while (true) {
+          bool found = queues[i].pop(game);
+          for (victim = (i + 1) % nthreads; !found && victim != i;
+               victim = (victim + 1) % nthreads) {
+            found = queues[victim].steal(game);
+            stats.steals += found;
+          }
+          // Nothing is ever queued after the start, so once every queue is
+          // empty the remaining games are all being played already.
+          if (!found)
+            break;
+          play(config, game, *policy, stats);
+        }
+        counters.tpc_stop();
+        stats.counters = counters.tpc_read();
+        stats.nodes = policy->get_nodes();
+      });
+    }
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+
+    tetris_run_stats total;
+    total.seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    total.threads = nthreads;
+    for (const tetris_run_stats &stats : results) {
+      total.games += stats.games;
+      total.ticks += stats.ticks;
+      total.points += stats.points;
+      total.capped += stats.capped;
+      total.steals += stats.steals;
+      total.nodes += stats.nodes;
+      total.counters.tcv_add(stats.counters);
+    }
+    return total;
+  }
+}
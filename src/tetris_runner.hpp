@@ -0,0 +1,90 @@
+/***************************************************************************//**
+
+  @file         tetris_runner.hpp
+
+  @brief        Play many headless games across all cores.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_counters.hpp"
+#include "tetris_policy.hpp"
+#include <cstdint>
+#include <string>
+
+namespace tetris{
+
+  struct tetris_run_config {
+    int games = 1000;
+    int rows = 22;
+    int cols = 10;
+    /*
+      Worker threads; 0 means one per hardware thread.
+    */
+    int threads = 0;
+    /*
+      Games that are still going after this many ticks are stopped, so that a
+      policy which never loses can't run forever.
+    */
+    long max_ticks = 1000000;
+    /*
+      Game i is seeded with seed + i, whichever thread plays it.
+    */
+    std::uint64_t seed = 0;
+    tetris_randomizer randomizer = TR_UNIFORM;
+    /*
+      Skip the ticks a policy waits out with tg_advance instead of ticking
+      through them.  Games play out the same either way.
+    */
+    bool warp = true;
+    /*
+      Directory to record a replay of every game into, as game-<i>.replay, or
+      empty for none.
+    */
+    std::string replays;
+    /*
+      Count hardware events on every worker (see tetris_counters.hpp).
+    */
+    bool counters = false;
+  };
+
+  struct tetris_run_stats {
+    long games = 0;
+    long ticks = 0;
+    long points = 0;
+    /*
+      Games stopped by max_ticks rather than lost.
+    */
+    long capped = 0;
+    /*
+      Games a worker took from another worker's queue.
+    */
+    long steals = 0;
+    /*
+      Search nodes visited by the policies.
+    */
+    long nodes = 0;
+    int threads = 0;
+    double seconds = 0;
+    /*
+      Hardware events over all workers, when config.counters is set.
+    */
+    tetris_counter_values counters;
+
+    double games_per_sec() const;
+    double ticks_per_sec() const;
+    double nodes_per_sec() const;
+  };
+
+  /*
+    Play config.games games to the end, each driven by a policy from factory.
+    Every worker thread makes its own policy and owns a queue of games; a worker
+    whose queue runs dry steals queued games from the others, so one long game
+    never leaves the rest of the machine idle.
+  */
+  tetris_run_stats tr_run(const tetris_run_config &config,
+                          const tetris_policy_factory &factory);
+}
@@ -0,0 +1,150 @@
+/***************************************************************************//**
+
+  @file         tetris_snapshot.cpp
+
+  @brief        Snapshot files: many packed games behind a fixed header.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_snapshot.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tetris{
+
+  static_assert(alignof(tetris_packed) == 1,
+                "records are read in place at any offset");
+
+  bool ts_write_header(FILE *f, std::uint64_t count)
+  {
+    std::uint8_t header[SNAPSHOT_HEADER_BYTES] = {0};
+    std::memcpy(header, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    store_le(header + 8, SNAPSHOT_VERSION, 4);
+    store_le(header + 12, PACKED_BYTES, 4);
+    store_le(header + SNAPSHOT_COUNT_OFFSET, count, 8);
+    return fwrite(header, sizeof(header), 1, f) == 1;
+  }
+
+  bool ts_read_header(const std::uint8_t *header, std::uint64_t &count)
+  {
+    if (std::memcmp(header, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        load_le(header + 8, 4) != SNAPSHOT_VERSION ||
+        load_le(header + 12, 4) != PACKED_BYTES)
+      return false;
+    count = load_le(header + SNAPSHOT_COUNT_OFFSET, 8);
+    return true;
+  }
+
+  /*******************************************************************************
+
+                                     Writer
+
+  *******************************************************************************/
+
+  tetris_snapshot_writer::tetris_snapshot_writer(FILE *f)
+    : f(f), start(ftell(f)), count(0), ok(ts_write_header(f, 0))
+  {
+  }
+
+  bool tetris_snapshot_writer::tsw_add(const tetris_game &game)
+  {
+    tetris_packed packed;
+    return game.tg_pack(packed) && tsw_add(packed);
+  }
+
+  bool tetris_snapshot_writer::tsw_add(const tetris_packed &packed)
+  {
+    if (fwrite(packed.bytes.data(), PACKED_BYTES, 1, f) != 1) {
+      ok = false;
+      return false;
+    }
+    count++;
+    return true;
+  }
+
+  bool tetris_snapshot_writer::tsw_finish()
+  {
+    std::uint8_t field[8];
+    long end = ftell(f);
+    store_le(field, count, 8);
+    ok = ok && start >= 0 && end >= 0 &&
+      fseek(f, start + SNAPSHOT_COUNT_OFFSET, SEEK_SET) == 0 &&
+      fwrite(field, sizeof(field), 1, f) == 1 &&
+      fseek(f, end, SEEK_SET) == 0 && fflush(f) == 0;
+    return ok;
+  }
+
+  /*******************************************************************************
+
+                                     Reader
+
+  *******************************************************************************/
+
+  tetris_snapshot::tetris_snapshot() : data(nullptr), length(0), count(0)
+  {
+  }
+
+  tetris_snapshot::~tetris_snapshot()
+  {
+    ts_close();
+  }
+
+  bool tetris_snapshot::ts_open(const char *path)
+  {
+    struct stat st;
+    void *map;
+    int fd;
+
+    ts_close();
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) SNAPSHOT_HEADER_BYTES) {
+      close(fd);
+      return false;
+    }
+    map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return false;
+
+    data = (const std::uint8_t *) map;
+    length = st.st_size;
+    if (!ts_read_header(data, count) ||
+        count > (length - SNAPSHOT_HEADER_BYTES) / PACKED_BYTES) {
+      ts_close();
+      return false;
+    }
+    return true;
+  }
+
+  void tetris_snapshot::ts_close()
+  {
+    if (data)
+      munmap((void *) data, length);
+    data = nullptr;
+    length = 0;
+    count = 0;
+  }
+
+  std::uint64_t tetris_snapshot::get_size() const
+  {
+    return count;
+  }
+
+  const tetris_packed &tetris_snapshot::get_packed(std::uint64_t i) const
+  {
+    return *reinterpret_cast<const tetris_packed *>(
+      data + SNAPSHOT_HEADER_BYTES + i * PACKED_BYTES);
+  }
+
+  bool tetris_snapshot::ts_load(std::uint64_t i, tetris_game &game) const
+  {
+    return i < count && game.tg_unpack(get_packed(i));
+  }
+}
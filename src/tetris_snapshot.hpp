@@ -0,0 +1,109 @@
+/***************************************************************************//**
+
+  @file         tetris_snapshot.hpp
+
+  @brief        Snapshot files: many packed games behind a fixed header.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include "tetris_game.hpp"
+#include "tetris_packed.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace tetris{
+
+  /*
+    A snapshot file is a header of SNAPSHOT_HEADER_BYTES followed by count
+    records of PACKED_BYTES each, record i at SNAPSHOT_HEADER_BYTES + i *
+    PACKED_BYTES.  Header fields, little-endian, at fixed offsets:
+
+      offset  bytes  field
+           0      8  SNAPSHOT_MAGIC
+           8      4  version, SNAPSHOT_VERSION
+          12      4  record size, PACKED_BYTES
+          16      8  count
+          24     40  zero
+
+    A reader refuses any other version or record size, so a change to the
+    packed layout must bump SNAPSHOT_VERSION.
+  */
+  constexpr char SNAPSHOT_MAGIC[8] = {'T', 'E', 'T', 'R', 'I', 'S', 'S', 'N'};
+  constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+  constexpr std::size_t SNAPSHOT_HEADER_BYTES = 64;
+  constexpr std::size_t SNAPSHOT_COUNT_OFFSET = 16;
+
+  /*
+    Write a header for count records at the current position of f.
+  */
+  bool ts_write_header(FILE *f, std::uint64_t count);
+  /*
+    Check a header and read its count.
+  */
+  bool ts_read_header(const std::uint8_t *header, std::uint64_t &count);
+
+  /*
+    Appends games to a snapshot file.  The header is written first with a
+    count of zero and fixed up by tsw_finish, which needs f to be seekable.
+  */
+  class tetris_snapshot_writer {
+
+    private:
+      FILE *f;
+      long start;
+      std::uint64_t count;
+      bool ok;
+
+    public:
+      explicit tetris_snapshot_writer(FILE *f);
+
+      /*
+        Add a game; false if it doesn't pack or the write fails.
+      */
+      bool tsw_add(const tetris_game &game);
+      bool tsw_add(const tetris_packed &packed);
+      /*
+        Record the count in the header.  Returns false if anything written
+        since construction failed.
+      */
+      bool tsw_finish();
+  };
+
+  /*
+    A snapshot file mapped read-only into memory.  Records are read in place:
+    get_packed returns a reference into the mapping, and nothing is copied until
+    a record is unpacked into a game.
+  */
+  class tetris_snapshot {
+
+    private:
+      const std::uint8_t *data;
+      std::size_t length;
+      std::uint64_t count;
+
+    public:
+      tetris_snapshot();
+      ~tetris_snapshot();
+      tetris_snapshot(const tetris_snapshot &) = delete;
+      tetris_snapshot &operator=(const tetris_snapshot &) = delete;
+
+      /*
+        Map the file at path, closing any file mapped before.  Fails if it
+        isn't a snapshot or is shorter than its header says.
+      */
+      bool ts_open(const char *path);
+      void ts_close();
+
+      std::uint64_t get_size() const;
+      const tetris_packed &get_packed(std::uint64_t i) const;
+      /*
+        Unpack record i into game.
+      */
+      bool ts_load(std::uint64_t i, tetris_game &game) const;
+  };
+}
@@ -0,0 +1,202 @@
+/***************************************************************************//**
+
+  @file         tetris_trace.cpp
+
+  @brief        Timeline tracing, written out in Chrome trace format.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+#include "tetris_trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace tetris{
+
+  static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0,
+                "TRACE_BUFFER_EVENTS is a power of two");
+
+  std::atomic<bool> trace_enabled(false);
+
+  /*
+    A span as stored.  The fields are atomic only so that tt_write can read a
+    buffer while its thread writes it; they are never contended.
+  */
+  struct trace_event {
+    std::atomic<const char *> name;
+    std::atomic<std::uint64_t> start;
+    std::atomic<std::uint64_t> end;
+  };
+
+  /*
+    One thread's ring of spans.  Only the owner writes; head counts every span
+    it has ever recorded, and is published after the span it covers.
+  */
+  struct trace_buffer {
+    int tid;
+    std::string name;
+    std::atomic<std::uint64_t> head;
+    std::unique_ptr<trace_event[]> events;
+  };
+
+  /*
+    Every thread's buffer, kept to the end of the process so that threads that
+    have exited still show up in the trace.  Taking the lock is only for
+    adding a thread, naming it, and writing the trace out.
+  */
+  static std::mutex trace_lock;
+  static std::vector<trace_buffer *> &trace_buffers()
+  {
+    static std::vector<trace_buffer *> *buffers =
+      new std::vector<trace_buffer *>();
+    return *buffers;
+  }
+
+  static thread_local trace_buffer *local_buffer = nullptr;
+  static std::uint64_t trace_epoch = 0;
+
+  static trace_buffer *tt_local()
+  {
+    if (!local_buffer) {
+      trace_buffer *b = new trace_buffer();
+      b->head.store(0, std::memory_order_relaxed);
+      b->events.reset(new trace_event[TRACE_BUFFER_EVENTS]);
+      std::lock_guard<std::mutex> guard(trace_lock);
+      b->tid = (int) trace_buffers().size() + 1;
+      trace_buffers().push_back(b);
+      local_buffer = b;
+    }
+    return local_buffer;
+  }
+
+  std::uint64_t tt_now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void tt_record(const char *name, std::uint64_t start, std::uint64_t end)
+  {
+    trace_buffer *b = tt_local();
+    std::uint64_t head = b->head.load(std::memory_order_relaxed);
+    trace_event &e = b->events[head & (TRACE_BUFFER_EVENTS - 1)];
+    // Pairs with the fence in tt_write: a reader that sees any of these
+    // stores then sees head at least where it is now.
+    std::atomic_thread_fence(std::memory_order_release);
+    e.name.store(name, std::memory_order_relaxed);
+    e.start.store(start, std::memory_order_relaxed);
+    e.end.store(end, std::memory_order_relaxed);
+    b->head.store(head + 1, std::memory_order_release);
+  }
+
+  void tt_thread_name(const char *name)
+  {
+    trace_buffer *b = tt_local();
+    std::lock_guard<std::mutex> guard(trace_lock);
+    b->name = name;
+  }
+
+  void tt_start()
+  {
+    trace_epoch = tt_now();
+    trace_enabled.store(true, std::memory_order_relaxed);
+  }
+
+  /*
+    A time in the trace, microseconds from tt_start.
+  */
+  static double trace_time(std::uint64_t ns)
+  {
+    return ns > trace_epoch ? (ns - trace_epoch) / 1000.0 : 0.0;
+  }
+
+  bool tt_write(const char *path)
+  {
+    struct copied {
+      const char *name;
+      std::uint64_t start, end;
+    };
+    std::vector<copied> events;
+    std::uint64_t head, first, i, overwritten;
+    const char *sep = "";
+    int pid = getpid();
+    FILE *f = fopen(path, "w");
+    if (!f)
+      return false;
+
+    std::lock_guard<std::mutex> guard(trace_lock);
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (trace_buffer *b : trace_buffers()) {
+      if (!b->name.empty()) {
+        fprintf(f, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+                "\"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                sep, pid, b->tid, b->name.c_str());
+        sep = ",";
+      }
+
+      // Copy out the spans still in the ring, then drop any that the thread
+      // wrapped around onto while they were being copied.  Span head is being
+      // written, over the slot of span head - TRACE_BUFFER_EVENTS, before head
+      // is published, so that one counts as overwritten too.  The fence keeps
+      // the copying loads ahead of the second load of head.
+      head = b->head.load(std::memory_order_acquire);
+      first = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+      events.clear();
+      for (i = first; i < head; i++) {
+        const trace_event &e = b->events[i & (TRACE_BUFFER_EVENTS - 1)];
+        events.push_back({e.name.load(std::memory_order_relaxed),
+                          e.start.load(std::memory_order_relaxed),
+                          e.end.load(std::memory_order_relaxed)});
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      head = b->head.load(std::memory_order_relaxed);
+      overwritten = head + 1 > TRACE_BUFFER_EVENTS
+                  ? head + 1 - TRACE_BUFFER_EVENTS : 0;
+      for (i = first; i < first + events.size(); i++) {
+        if (i < overwritten)
+          continue;
+        const copied &e = events[i - first];
+        fprintf(f, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, "
+                "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                sep, e.name, pid, b->tid, trace_time(e.start),
+                (e.end - e.start) / 1000.0);
+        sep = ",";
+      }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+  }
+
+#ifdef TETRIS_TRACE
+
+  /*
+    Turns tracing on at startup when TETRIS_TRACE names a file, and writes the
+    trace there at exit.
+  */
+  static struct trace_session {
+    const char *path;
+
+    trace_session() : path(getenv("TETRIS_TRACE"))
+    {
+      if (path && *path)
+        tt_start();
+    }
+
+    ~trace_session()
+    {
+      if (!path || !*path)
+        return;
+      if (!tt_write(path))
+        fprintf(stderr, "can't write trace %s\n", path);
+    }
+  } session;
+
+#endif
+}
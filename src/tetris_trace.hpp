@@ -0,0 +1,100 @@
+/***************************************************************************//**
+
+  @file         tetris_trace.hpp
+
+  @brief        Timeline tracing, written out in Chrome trace format.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Tracing is compiled in only with TETRIS_TRACE defined (make TRACE=1).  Then,
+  running with the environment variable TETRIS_TRACE set to a path records
+  every span, and writes them to that path at exit as Chrome trace JSON, which
+  chrome://tracing and ui.perfetto.dev open.  Without TETRIS_TRACE defined the
+  macros are empty and cost nothing.
+
+    TRACE_SPAN("name");     times the rest of the enclosing block
+    TRACE_THREAD("name");   names the calling thread in the timeline
+*/
+#ifdef TETRIS_TRACE
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SPAN(name) \
+  ::tetris::tetris_trace_span TRACE_JOIN(trace_span_, __LINE__)(name)
+#define TRACE_THREAD(name) ::tetris::tt_thread_name(name)
+#else
+#define TRACE_SPAN(name) do {} while (0)
+#define TRACE_THREAD(name) do {} while (0)
+#endif
+
+namespace tetris{
+
+  /*
+    Spans kept per thread.  Once a thread's buffer is full each new span
+    replaces its oldest, so a trace always has the latest stretch of time.
+  */
+  constexpr std::size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+  extern std::atomic<bool> trace_enabled;
+
+  inline bool tt_enabled()
+  {
+    return trace_enabled.load(std::memory_order_relaxed);
+  }
+
+  /*
+    Nanoseconds on the steady clock.
+  */
+  std::uint64_t tt_now();
+  /*
+    Add a span to the calling thread's buffer.  name must outlive the trace;
+    string literals do.
+  */
+  void tt_record(const char *name, std::uint64_t start, std::uint64_t end);
+  void tt_thread_name(const char *name);
+  /*
+    Start recording spans, with times in the trace counted from now.
+  */
+  void tt_start();
+  /*
+    Write every thread's spans to path.  Threads may still be recording; spans
+    they overwrite while it runs are left out.
+  */
+  bool tt_write(const char *path);
+
+  /*
+    Records a span from its construction to the end of its scope.
+  */
+  class tetris_trace_span {
+
+    private:
+      const char *name;
+      std::uint64_t start;
+      bool on;
+
+    public:
+      explicit tetris_trace_span(const char *name)
+        : name(name), start(0), on(tt_enabled())
+      {
+        if (on)
+          start = tt_now();
+      }
+
+      ~tetris_trace_span()
+      {
+        if (on)
+          tt_record(name, start, tt_now());
+      }
+
+      tetris_trace_span(const tetris_trace_span &) = delete;
+      tetris_trace_span &operator=(const tetris_trace_span &) = delete;
+  };
+}
@@ -0,0 +1,213 @@
+/***************************************************************************//**
+
+  @file         batch_check.cpp
+
+  @brief        Play tetris_batch and tetris_game side by side and compare them.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+#include "tetris_batch.hpp"
+#include "tetris_policy.hpp"
+
+using namespace tetris;
+
+static const char *ISA_NAMES[] = {"scalar", "sse2", "avx2"};
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-n games] [-m max_ticks] [-r rows] [-s seed] [-b]\n"
+          "          [-w beam width] [-d search depth]\n"
+          "Plays the same games on a tetris_batch for every kernel path the\n"
+          "CPU has and on tetris_game objects, on boards 4 to 10 columns wide,\n"
+          "and stops at the first difference.  The beam policy picks the moves\n"
+          "(-w and -d set it up), so lines are cleared and levels go up.\n"
+          "Also checks that the preview shows the piece that comes after\n"
+          "next.\n",
+          name);
+}
+
+/*
+  Compare game g of the batch with tg, which is still running or not, printing
+  the first field that differs.
+*/
+static bool same(const tetris_batch &tb, int g, const tetris_game &tg,
+                 bool running)
+{
+  tetris_block a, b;
+  int r, c;
+  if (tb.get_running(g) != running) {
+    printf("running: %d vs %d\n", tb.get_running(g), running);
+    return false;
+  }
+  if (tb.get_points(g) != tg.get_points() ||
+      tb.get_level(g) != tg.get_level() ||
+      tb.get_lines_remaining(g) != tg.get_lines_remaining() ||
+      tb.get_ticks_till_gravity(g) != tg.get_ticks_till_gravity()) {
+    printf("counters: points %d/%d level %d/%d lines %d/%d ticks %d/%d\n",
+           tb.get_points(g), tg.get_points(), tb.get_level(g), tg.get_level(),
+           tb.get_lines_remaining(g), tg.get_lines_remaining(),
+           tb.get_ticks_till_gravity(g), tg.get_ticks_till_gravity());
+    return false;
+  }
+  a = tb.get_falling(g);
+  b = tg.get_falling();
+  if (a.typ != b.typ || a.ori != b.ori || a.loc.row != b.loc.row ||
+      a.loc.col != b.loc.col) {
+    printf("falling: %d/%d at (%d,%d) vs %d/%d at (%d,%d)\n", a.typ, a.ori,
+           a.loc.row, a.loc.col, b.typ, b.ori, b.loc.row, b.loc.col);
+    return false;
+  }
+  if (tb.get_next(g).typ != tg.get_next().typ ||
+      tb.get_stored(g).typ != tg.get_stored().typ ||
+      (tg.get_stored().typ != -1 &&
+       tb.get_stored(g).ori != tg.get_stored().ori) ||
+      tb.get_preview(g, 0) != tg.get_preview(0)) {
+    printf("pieces: next %d/%d stored %d/%d preview %d/%d\n",
+           tb.get_next(g).typ, tg.get_next().typ, tb.get_stored(g).typ,
+           tg.get_stored().typ, tb.get_preview(g, 0), tg.get_preview(0));
+    return false;
+  }
+  for (r = 0; r < tg.get_rows(); r++) {
+    for (c = 0; c < tg.get_cols(); c++) {
+      if (tb.tb_get(g, r, c) != tg.tg_get(r, c)) {
+        printf("cell (%d,%d): %d vs %d\n", r, c, tb.tb_get(g, r, c),
+               tg.tg_get(r, c));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+  Check that tg's preview starts with the piece that spawns after next, by
+  locking the falling block in a copy of the game.
+*/
+static bool preview_ok(const tetris_game &tg)
+{
+  tetris_game after = tg;
+  after.tg_place(after.tg_ghost());
+  if (after.get_next().typ != tg.get_preview(0)) {
+    printf("preview: %d, but %d came after next\n", tg.get_preview(0),
+           after.get_next().typ);
+    return false;
+  }
+  return true;
+}
+
+/*
+  Play games on a cols wide board until they all end or max_ticks pass, with
+  moves from the beam policy, and step one batch per kernel path with the same
+  moves.  Returns false at the first difference.
+*/
+static bool check(int n, long max_ticks, int rows, int cols,
+                  std::uint64_t seed, tetris_randomizer randomizer,
+                  const tetris_policy_factory &factory)
+{
+  int isas = tetris_batch::get_isa() + 1;
+  std::vector<tetris_batch> batches;
+  std::vector<tetris_game> games;
+  std::vector<std::unique_ptr<tetris_policy>> policies;
+  std::vector<tetris_move> moves(n, TM_NONE);
+  std::vector<char> game_running(n, true);
+  long tick, points = 0;
+  int g, isa, level = 0, running = n;
+  bool ok = true;
+
+  for (isa = 0; isa < isas; isa++) {
+    batches.emplace_back(n, rows, cols, seed, randomizer);
+  }
+  for (g = 0; g < n; g++) {
+    games.emplace_back(rows, cols, seed + g, randomizer);
+    policies.push_back(factory());
+    policies.back()->reset(seed + g);
+  }
+  for (tick = 0; ok && running > 0 && tick < max_ticks; tick++) {
+    for (g = 0; g < n; g++) {
+      moves[g] = game_running[g] ? policies[g]->choose(games[g]) : TM_NONE;
+    }
+    running = 0;
+    for (g = 0; g < n; g++) {
+      if (game_running[g])
+        game_running[g] = games[g].tg_tick(moves[g]);
+      running += game_running[g];
+    }
+    for (isa = 0; ok && isa < isas; isa++) {
+      tetris_batch::tb_set_isa((tetris_batch_isa) isa);
+      batches[isa].tb_step(moves.data());
+      for (g = 0; ok && g < n; g++) {
+        if (!same(batches[isa], g, games[g], game_running[g]) ||
+            (game_running[g] && !preview_ok(games[g]))) {
+          printf("%s, %d columns: game %d differs after tick %ld\n",
+                 ISA_NAMES[isa], cols, g, tick);
+          ok = false;
+        }
+      }
+    }
+  }
+  tetris_batch::tb_set_isa((tetris_batch_isa) (isas - 1));
+  if (!ok)
+    return false;
+
+  for (g = 0; g < n; g++) {
+    points += games[g].get_points();
+    level = std::max(level, games[g].get_level());
+  }
+  printf("%2d columns: %d games, %ld ticks, %ld points, up to level %d, "
+         "the same on", cols, n, tick, points, level);
+  for (isa = 0; isa < isas; isa++) {
+    printf(" %s", ISA_NAMES[isa]);
+  }
+  printf("\n");
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  tetris_randomizer randomizer = TR_UNIFORM;
+  tetris_ai_config ai;
+  std::uint64_t seed = 1;
+  long max_ticks = 20000;
+  int n = 13, rows = 22, cols;
+  int opt;
+
+  // A quick search still plays well enough to reach the top level.
+  ai.beam = 4;
+  ai.depth = 1;
+  ai.table_bits = 12;
+  while ((opt = getopt(argc, argv, "n:m:r:s:bw:d:h")) != -1) {
+    switch (opt) {
+    case 'n': n = atoi(optarg); break;
+    case 'm': max_ticks = atol(optarg); break;
+    case 'r': rows = atoi(optarg); break;
+    case 's': seed = strtoull(optarg, nullptr, 0); break;
+    case 'b': randomizer = TR_BAG; break;
+    case 'w': ai.beam = atoi(optarg); break;
+    case 'd': ai.depth = atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (n < 0 || !tg_valid_size(rows, 10)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  tetris_policy_factory factory = tp_factory("beam", ai);
+  for (cols = 4; cols <= 10; cols++) {
+    if (!check(n, max_ticks, rows, cols, seed, randomizer, factory))
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,485 @@
+/***************************************************************************//**
+
+  @file         bench.cpp
+
+  @brief        Time the engine's inner steps and whole games.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "tetris_counters.hpp"
+#include "tetris_game.hpp"
+
+namespace tetris{
+
+  /*
+    Reaches the private steps of a game, so they can be timed on their own.
+  */
+  class tetris_bench {
+
+    public:
+      static bool fits(const tetris_game &game, tetris_block block)
+      {
+        return game.tg_fits(block);
+      }
+
+      static void set(tetris_game &game, int row, int col, char value)
+      {
+        game.tg_set(row, col, value);
+      }
+
+      /*
+        Bring the heights up to date after set, and mark rows for
+        tg_check_lines to look at.
+      */
+      static void settle(tetris_game &game, tetris_row locked)
+      {
+        game.tg_update_heights();
+        game.locked_rows = locked;
+      }
+
+      static int check_lines(tetris_game &game)
+      {
+        return game.tg_check_lines();
+      }
+
+      static void set_falling(tetris_game &game, tetris_block block)
+      {
+        game.falling = block;
+      }
+
+      static void down(tetris_game &game)
+      {
+        game.tg_down();
+      }
+
+      static void rotate(tetris_game &game, int direction)
+      {
+        game.tg_rotate(direction);
+      }
+  };
+}
+
+using namespace tetris;
+using bench_clock = std::chrono::steady_clock;
+
+/*
+  A benchmark runs its operation a given number of times.  Anything it sets up
+  beforehand is outside the timing.
+*/
+struct benchmark {
+  std::string name;
+  std::function<void(long)> run;
+};
+
+struct bench_stats {
+  long iterations;
+  double min, median, mean, stddev, max;
+  /*
+    Hardware events per iteration over the timed repetitions, if counted.
+  */
+  tetris_counter_values counters;
+};
+
+/*
+  Keep the compiler from optimizing away a result that is never used.
+*/
+template <typename T>
+static inline void keep(const T &value)
+{
+  asm volatile("" : : "m"(value) : "memory");
+}
+
+static double seconds_since(bench_clock::time_point start)
+{
+  return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/*
+  Warm up for about warmup seconds, which also finds how many iterations fill
+  rep_time, then time reps repetitions of that many.  Statistics are in
+  nanoseconds per iteration.  With counters, also count hardware events over
+  the repetitions.
+*/
+static bench_stats measure(const benchmark &b, int reps, double warmup,
+                           double rep_time, tetris_perf_counters *counters)
+{
+  bench_stats stats;
+  std::vector<double> ns;
+  bench_clock::time_point start = bench_clock::now(), rep;
+  double elapsed, sum = 0, squares = 0;
+  long n = 1, done = 0;
+
+  while ((elapsed = seconds_since(start)) < warmup || done == 0) {
+    b.run(n);
+    done += n;
+    n *= 2;
+  }
+  stats.iterations = std::max(1L, (long) (done / elapsed * rep_time));
+
+  if (counters)
+    counters->tpc_start();
+  for (int i = 0; i < reps; i++) {
+    rep = bench_clock::now();
+    b.run(stats.iterations);
+    ns.push_back(seconds_since(rep) * 1e9 / stats.iterations);
+  }
+  if (counters) {
+    counters->tpc_stop();
+    stats.counters = counters->tpc_read();
+    for (double &count : stats.counters.counts) {
+      count /= (double) reps * stats.iterations;
+    }
+  }
+  std::sort(ns.begin(), ns.end());
+  for (double x : ns) {
+    sum += x;
+  }
+  stats.mean = sum / reps;
+  for (double x : ns) {
+    squares += (x - stats.mean) * (x - stats.mean);
+  }
+  stats.stddev = reps > 1 ? std::sqrt(squares / (reps - 1)) : 0;
+  stats.min = ns.front();
+  stats.max = ns.back();
+  stats.median = reps % 2 ? ns[reps / 2] : (ns[reps / 2 - 1] + ns[reps / 2]) / 2;
+  return stats;
+}
+
+/*
+  A board with a ragged stack in its bottom filled rows: every row but the top
+  one has a single hole, in a different column each time.  With full set, the
+  bottom full rows have no hole, and the bottom TETRIS rows are marked for
+  tg_check_lines.
+*/
+static tetris_game stack_board(int filled, int full)
+{
+  tetris_game game(22, 10, 1);
+  int rows = game.get_rows(), cols = game.get_cols(), r, c;
+  for (r = rows - filled; r < rows; r++) {
+    for (c = 0; c < cols; c++) {
+      if (r >= rows - full || c != (r * 3) % cols)
+        tetris_bench::set(game, r, c, TYPE_TO_CELL(r % NUM_TETROMINOS));
+    }
+  }
+  tetris_bench::settle(game, ((tetris_row(1) << TETRIS) - 1) << (rows - TETRIS));
+  return game;
+}
+
+/*
+  Every orientation and column of every piece at row, some of which overlap
+  the stack or the walls.
+*/
+static std::vector<tetris_block> blocks_at(int row)
+{
+  std::vector<tetris_block> blocks;
+  for (int typ = 0; typ < NUM_TETROMINOS; typ++) {
+    for (int ori = 0; ori < NUM_ORIENTATIONS; ori++) {
+      for (int col = -1; col < 9; col++) {
+        blocks.push_back(tetris_block{typ, ori, {row, col}});
+      }
+    }
+  }
+  return blocks;
+}
+
+static std::vector<benchmark> benchmarks()
+{
+  std::vector<benchmark> all;
+
+  // tg_fits over every block in open space, and at the top of the stack where
+  // most of them collide.
+  for (int row : {2, 12}) {
+    tetris_game game = stack_board(8, 0);
+    std::vector<tetris_block> blocks = blocks_at(row);
+    all.push_back({row < 10 ? "tg_fits/open" : "tg_fits/stack",
+                   [game, blocks](long n) {
+                     std::size_t i = 0;
+                     for (long k = 0; k < n; k++) {
+                       bool fits = tetris_bench::fits(game, blocks[i]);
+                       keep(fits);
+                       i = i + 1 < blocks.size() ? i + 1 : 0;
+                     }
+                   }});
+  }
+
+  // Locking a piece and taking it back out: tg_put and its undo, through
+  // tg_place so the game stays consistent.
+  {
+    tetris_game game = stack_board(8, 0);
+    std::vector<tetris_block> blocks;
+    for (tetris_block block : blocks_at(0)) {
+      if (tetris_bench::fits(game, block)) {
+        block.loc.row += game.tg_drop_distance(block);
+        blocks.push_back(block);
+      }
+    }
+    all.push_back({"tg_place+tg_undo", [game, blocks](long n) mutable {
+                     tetris_undo undo;
+                     std::size_t i = 0;
+                     for (long k = 0; k < n; k++) {
+                       game.tg_place(blocks[i], undo);
+                       game.tg_undo(undo);
+                       i = i + 1 < blocks.size() ? i + 1 : 0;
+                     }
+                     keep(game);
+                   }});
+  }
+
+  // Copying a game, which the benchmarks below do before every operation that
+  // changes it.  Subtract this from them for the cost of the step alone.
+  {
+    tetris_game game = stack_board(8, 0);
+    all.push_back({"tetris_game copy", [game](long n) {
+                     tetris_game work = game;
+                     for (long k = 0; k < n; k++) {
+                       keep(game);
+                       work = game;
+                       keep(work);
+                     }
+                   }});
+  }
+
+  for (int full = 0; full <= TETRIS; full++) {
+    tetris_game game = stack_board(8, full);
+    all.push_back({"tg_check_lines/" + std::to_string(full),
+                   [game](long n) {
+                     tetris_game work = game;
+                     for (long k = 0; k < n; k++) {
+                       keep(game);
+                       work = game;
+                       int lines = tetris_bench::check_lines(work);
+                       keep(lines);
+                     }
+                   }});
+  }
+
+  // tg_down for a block falling each distance onto the stack.
+  for (int distance : {0, 4, 8, 12}) {
+    tetris_game game = stack_board(8, 0);
+    tetris_block block = game.tg_spawn(2);
+    block.loc.row = game.tg_drop_distance(block) - distance;
+    tetris_bench::set_falling(game, block);
+    all.push_back({"tg_down/" + std::to_string(distance), [game](long n) {
+                     tetris_game work = game;
+                     for (long k = 0; k < n; k++) {
+                       keep(game);
+                       work = game;
+                       tetris_bench::down(work);
+                       keep(work);
+                     }
+                   }});
+  }
+
+  // tg_rotate for a T in open space, and for an upright I at the bottom of a
+  // one-column well, where every orientation and wall kick is tried and none
+  // fit.
+  {
+    tetris_game game = stack_board(8, 0);
+    tetris_bench::set_falling(game, tetris_block{5, 0, {4, 3}});
+    all.push_back({"tg_rotate/open", [game](long n) mutable {
+                     for (long k = 0; k < n; k++) {
+                       tetris_bench::rotate(game, 1);
+                       keep(game);
+                     }
+                   }});
+  }
+  {
+    tetris_game game(22, 10, 1);
+    tetris_block block{0, 1, {0, 0}};
+    int r, c, well;
+    for (r = 8; r < game.get_rows(); r++) {
+      for (c = 0; c < game.get_cols(); c++) {
+        if (c != 4)
+          tetris_bench::set(game, r, c, TC_CELLJ);
+      }
+    }
+    tetris_bench::settle(game, 0);
+    // Line the I's cells up with the well, then drop it to the bottom.
+    well = 4 - TETROMINOS[block.typ][block.ori][0].col;
+    block.loc.col = well;
+    block.loc.row += game.tg_drop_distance(block);
+    tetris_bench::set_falling(game, block);
+    all.push_back({"tg_rotate/cramped", [game](long n) mutable {
+                     for (long k = 0; k < n; k++) {
+                       tetris_bench::rotate(game, 1);
+                       keep(game);
+                     }
+                   }});
+  }
+
+  // Whole games under a fixed stream of moves: mostly waiting, with some
+  // moving, rotating and dropping.  A game that ends starts over.
+  {
+    std::vector<tetris_move> script(1 << 12);
+    std::uint32_t x = 1;
+    for (tetris_move &move : script) {
+      x = x * 1664525 + 1013904223;
+      switch ((x >> 24) % 16) {
+      case 0: move = TM_LEFT; break;
+      case 1: move = TM_RIGHT; break;
+      case 2: move = TM_CLOCK; break;
+      case 3: move = TM_DROP; break;
+      default: move = TM_NONE; break;
+      }
+    }
+    tetris_game start(22, 10, 1);
+    all.push_back({"tg_tick/script", [start, script](long n) {
+                     tetris_game game = start;
+                     std::size_t i = 0;
+                     for (long k = 0; k < n; k++) {
+                       if (!game.tg_tick(script[i]))
+                         game = start;
+                       i = i + 1 < script.size() ? i + 1 : 0;
+                     }
+                     keep(game);
+                   }});
+  }
+
+  return all;
+}
+
+/*
+  Write s as a JSON string.
+*/
+static void json_string(FILE *f, const std::string &s)
+{
+  fputc('"', f);
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      fputc('\\', f);
+    if ((unsigned char) c < 0x20)
+      fprintf(f, "\\u%04x", c);
+    else
+      fputc(c, f);
+  }
+  fputc('"', f);
+}
+
+/*
+  An indented line of the events per op under a benchmark's row, with IPC.
+*/
+static void print_counters(FILE *f, const tetris_counter_values &c)
+{
+  fprintf(f, "   ");
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    if (c.valid[i])
+      fprintf(f, " %s %.2f", COUNTER_NAMES[i], c.counts[i]);
+  }
+  if (c.valid[TPC_CYCLES] && c.valid[TPC_INSTRUCTIONS] &&
+      c.counts[TPC_CYCLES] > 0)
+    fprintf(f, " IPC %.2f", c.counts[TPC_INSTRUCTIONS] / c.counts[TPC_CYCLES]);
+  fprintf(f, "\n");
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-r repetitions] [-w warmup ms] [-t ms per repetition]\n"
+          "          [-f filter] [-l label] [-o file.json] [-P]\n"
+          "-f runs only benchmarks whose name contains filter\n"
+          "-l names this run in the JSON, e.g. with the commit it was built from\n"
+          "-o writes the results as JSON to a file (- for stdout)\n"
+          "-P counts cycles, instructions and misses per op with "
+          "perf_event_open\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+  int reps = 10, opt;
+  double warmup = 0.1, rep_time = 0.02;
+  const char *filter = "", *label = "", *output = nullptr;
+  tetris_perf_counters perf;
+  bool count = false;
+  std::vector<std::pair<std::string, bench_stats>> results;
+  FILE *f;
+
+  while ((opt = getopt(argc, argv, "r:w:t:f:l:o:Ph")) != -1) {
+    switch (opt) {
+    case 'r': reps = std::max(1, atoi(optarg)); break;
+    case 'w': warmup = atof(optarg) / 1000; break;
+    case 't': rep_time = atof(optarg) / 1000; break;
+    case 'f': filter = optarg; break;
+    case 'l': label = optarg; break;
+    case 'o': output = optarg; break;
+    case 'P': count = true; break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  // With the JSON on stdout, the table goes to stderr.
+  FILE *table = output && strcmp(output, "-") == 0 ? stderr : stdout;
+  if (count && !perf.tpc_open()) {
+    fprintf(stderr, "hardware counters unavailable "
+            "(see /proc/sys/kernel/perf_event_paranoid)\n");
+    count = false;
+  }
+  fprintf(table, "%-24s %12s %12s %12s %9s\n", "(ns per op)", "iterations",
+          "median", "min", "stddev");
+  for (const benchmark &b : benchmarks()) {
+    if (b.name.find(filter) == std::string::npos)
+      continue;
+    bench_stats s = measure(b, reps, warmup, rep_time, count ? &perf : nullptr);
+    fprintf(table, "%-24s %12ld %12.2f %12.2f %8.1f%%\n", b.name.c_str(),
+            s.iterations, s.median, s.min,
+            s.mean > 0 ? 100 * s.stddev / s.mean : 0.0);
+    if (count)
+      print_counters(table, s.counters);
+    fflush(table);
+    results.push_back({b.name, s});
+  }
+
+  if (!output)
+    return 0;
+  f = strcmp(output, "-") == 0 ? stdout : fopen(output, "w");
+  if (!f) {
+    fprintf(stderr, "can't write %s\n", output);
+    return 1;
+  }
+  fprintf(f, "{\n  \"label\": ");
+  json_string(f, label);
+  fprintf(f, ",\n  \"compiler\": ");
+  json_string(f, __VERSION__);
+  fprintf(f, ",\n  \"repetitions\": %d,\n  \"unit\": \"ns\",\n", reps);
+  fprintf(f, "  \"benchmarks\": [");
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const bench_stats &s = results[i].second;
+    fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+    json_string(f, results[i].first);
+    fprintf(f, ", \"iterations\": %ld, \"median\": %.3f, \"mean\": %.3f, "
+            "\"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f",
+            s.iterations, s.median, s.mean, s.stddev, s.min, s.max);
+    if (s.counters.tcv_any()) {
+      fprintf(f, ", \"counters\": {");
+      const char *sep = "";
+      for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (!s.counters.valid[c])
+          continue;
+        fprintf(f, "%s\"%s\": %.4f", sep, COUNTER_NAMES[c], s.counters.counts[c]);
+        sep = ", ";
+      }
+      fprintf(f, "}");
+    }
+    fprintf(f, "}");
+  }
+  fprintf(f, "\n  ]\n}\n");
+  if (f != stdout && fclose(f) != 0) {
+    fprintf(stderr, "can't write %s\n", output);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+/***************************************************************************//**
+
+  @file         replay.cpp
+
+  @brief        Play a recorded game back at full speed and report the result.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "tetris_replay.hpp"
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-m max_ticks] [-s tick] [-p] file.replay\n"
+          "-s jumps to tick from the nearest keyframe instead of playing\n"
+          "-p prints the board at the end\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+  tetris::tetris_replay replay;
+  std::uint64_t max_ticks = UINT64_MAX, seek = 0;
+  bool print = false, seeking = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:s:ph")) != -1) {
+    switch (opt) {
+    case 'm': max_ticks = strtoull(optarg, nullptr, 0); break;
+    case 's': seek = strtoull(optarg, nullptr, 0); seeking = true; break;
+    case 'p': print = true; break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!replay.trp_open(argv[optind])) {
+    fprintf(stderr, "can't read replay %s\n", argv[optind]);
+    return 1;
+  }
+
+  tetris::tetris_game game = replay.get_start();
+  auto start = std::chrono::steady_clock::now();
+  if (!seeking)
+    replay.trp_play(game, max_ticks);
+  else if (!replay.trp_seek(seek, game))
+    fprintf(stderr, "replay ends before tick %llu\n", (unsigned long long) seek);
+  std::uint64_t ticks = replay.get_tick();
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+
+  if (print)
+    game.tg_print(stdout);
+  printf("seed:       %llu\n", (unsigned long long) game.get_seed());
+  printf("ticks:      %llu\n", (unsigned long long) ticks);
+  printf("points:     %d\n", game.get_points());
+  printf("level:      %d\n", game.get_level());
+  printf("time:       %.3f s\n", seconds);
+  printf("keyframes:  %zu\n", replay.get_index().size());
+  if (!seeking)
+    printf("ticks/sec:  %.0f\n", seconds > 0 ? ticks / seconds : 0.0);
+  return 0;
+}
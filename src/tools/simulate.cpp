@@ -0,0 +1,116 @@
+/***************************************************************************//**
+
+  @file         simulate.cpp
+
+  @brief        Play headless games on every core and report throughput.
+
+  @copyright    Copyright (c) 2015, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "tetris_runner.hpp"
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-n games] [-j threads] [-p policy] [-m max_ticks]\n"
+          "          [-r rows] [-c cols] [-s seed] [-b]\n"
+          "          [-w beam width] [-d search depth] [-t search ms]\n"
+          "          [-R replay dir] [-S] [-P]\n"
+          "policies: idle, random, beam\n"
+          "-b deals pieces from shuffled bags of seven\n"
+          "-R records every game to replay dir/game-<i>.replay\n"
+          "-S steps every tick instead of skipping idle ones\n"
+          "-P counts cycles, instructions and misses with perf_event_open\n",
+          name);
+}
+
+/*
+  Hardware events per tick and per game.  Ticks skipped by tg_advance count
+  as ticks, so -S gives the cost of stepping every one.
+*/
+static void print_counters(const tetris::tetris_run_stats &stats)
+{
+  const tetris::tetris_counter_values &c = stats.counters;
+  if (!c.tcv_any()) {
+    printf("counters:   unavailable (see /proc/sys/kernel/perf_event_paranoid)\n");
+    return;
+  }
+  for (int i = 0; i < tetris::NUM_COUNTERS; i++) {
+    printf("%-12s", (std::string(tetris::COUNTER_NAMES[i]) + ":").c_str());
+    if (c.valid[i])
+      printf("%.2f per tick, %.0f per game\n",
+             stats.ticks ? c.counts[i] / stats.ticks : 0.0,
+             stats.games ? c.counts[i] / stats.games : 0.0);
+    else
+      printf("unavailable\n");
+  }
+  if (c.valid[tetris::TPC_CYCLES] && c.valid[tetris::TPC_INSTRUCTIONS] &&
+      c.counts[tetris::TPC_CYCLES] > 0)
+    printf("IPC:        %.2f\n", c.counts[tetris::TPC_INSTRUCTIONS] /
+                                  c.counts[tetris::TPC_CYCLES]);
+}
+
+int main(int argc, char *argv[])
+{
+  tetris::tetris_run_config config;
+  tetris::tetris_ai_config ai;
+  std::string policy = "random";
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:j:p:m:r:c:s:bw:d:t:R:SPh")) != -1) {
+    switch (opt) {
+    case 'n': config.games = atoi(optarg); break;
+    case 'j': config.threads = atoi(optarg); break;
+    case 'p': policy = optarg; break;
+    case 'm': config.max_ticks = atol(optarg); break;
+    case 'r': config.rows = atoi(optarg); break;
+    case 'c': config.cols = atoi(optarg); break;
+    case 's': config.seed = strtoull(optarg, nullptr, 0); break;
+    case 'b': config.randomizer = tetris::TR_BAG; break;
+    case 'w': ai.beam = atoi(optarg); break;
+    case 'd': ai.depth = atoi(optarg); break;
+    case 't': ai.budget = atof(optarg) / 1000; break;
+    case 'R': config.replays = optarg; break;
+    case 'S': config.warp = false; break;
+    case 'P': config.counters = true; break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!tetris::tg_valid_size(config.rows, config.cols)) {
+    fprintf(stderr, "board must be 1 to %d rows and %d to %d columns\n",
+            tetris::MAX_ROWS, tetris::MIN_COLS, tetris::MAX_COLS);
+    return 1;
+  }
+
+  tetris::tetris_policy_factory factory = tetris::tp_factory(policy, ai);
+  if (!factory) {
+    fprintf(stderr, "unknown policy: %s\n", policy.c_str());
+    usage(argv[0]);
+    return 1;
+  }
+
+  tetris::tetris_run_stats stats = tetris::tr_run(config, factory);
+  printf("games:      %ld (%ld stopped at %ld ticks)\n", stats.games,
+         stats.capped, config.max_ticks);
+  printf("threads:    %d (%ld games stolen)\n", stats.threads, stats.steals);
+  printf("ticks:      %ld\n", stats.ticks);
+  printf("points:     %.1f per game\n",
+         stats.games ? (double) stats.points / stats.games : 0.0);
+  printf("time:       %.3f s\n", stats.seconds);
+  printf("games/sec:  %.1f\n", stats.games_per_sec());
+  printf("ticks/sec:  %.0f\n", stats.ticks_per_sec());
+  if (stats.nodes)
+    printf("nodes/sec:  %.0f\n", stats.nodes_per_sec());
+  if (config.counters)
+    print_counters(stats);
+  return 0;
+}
@@ -2,7 +2,20 @@
 #include <ncurses.h>
 #include "tetris_game.hpp"
 #include "tetris_location.hpp"
-#include "util.hpp"
+#include "tetris_trace.hpp"
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <thread>
 
 namespace tetris{
     /*
@@ -15,36 +28,71 @@ namespace tetris{
         waddch((w), character);
 
     }
+    inline void visual_game::ADD_GHOST(WINDOW* w, char x){
+        waddch((w), '['|COLOR_PAIR(x));
+        waddch((w), ']'|COLOR_PAIR(x));
+    }
     inline void visual_game::ADD_EMPTY(WINDOW* w){
         waddch((w), ' '); 
         waddch((w), ' ');
     }
 
-    void visual_game::display_board(WINDOW *w, tetris_game& tg)
+    void visual_game::display_board(WINDOW *w, const tetris_frame& f)
     {
-    int i, j;
-    box(w, 0, 0);
-    for (i = 0; i < tg.get_rows(); i++) {
-        wmove(w, 1 + i, 1);
-        for (j = 0; j < tg.get_cols(); j++) {
-        if (TC_IS_FILLED(tg.tg_get(i, j))) {
-            ADD_BLOCK(w, tg.tg_get(i, j));
+    TRACE_SPAN("display_board");
+    int i, j, shift;
+    bool changed = false;
+    tetris_color_row diff;
+
+    // Only cells that differ from what is on screen are drawn.
+    for (i = 0; i < f.rows; i++) {
+        diff = f.cells[i] ^ shown[i];
+        for (j = 0; diff && j < f.cols; j++) {
+        shift = BITS_PER_COLOR * j;
+        if (!((diff >> shift) & 0xF))
+            continue;
+        diff &= ~(tetris_color_row(0xF) << shift);
+        char cell = (f.cells[i] >> shift) & 0xF;
+        wmove(w, 1 + i, 1 + j * COLS_PER_CELL);
+        if (cell & CELL_GHOST) {
+            ADD_GHOST(w, cell & ~CELL_GHOST);
+        } else if (TC_IS_FILLED(cell)) {
+            ADD_BLOCK(w, cell);
         } else {
             ADD_EMPTY(w);
         }
+        changed = true;
         }
+        shown[i] = f.cells[i];
+    }
+    if (changed)
+        wnoutrefresh(w);
     }
+
+    /*
+    Forget what the board window shows, so the next frame draws all of it.
+    */
+    void visual_game::reset_board(WINDOW *w)
+    {
+    werase(w);
+    box(w, 0, 0);
+    shown.fill(CELL_UNDRAWN);
     wnoutrefresh(w);
     }
 
     /*
-    Display a tetris piece in a dedicated window.
+    Display a tetris piece in a dedicated window, if it changed.
     */
-    void visual_game::display_piece(WINDOW* w, tetris_block block)
+    void visual_game::display_piece(WINDOW* w, tetris_block block,
+                                    tetris_block &shown_block)
     {
+        TRACE_SPAN("display_piece");
         int b;
         tetris_location c;
-        wclear(w);
+        if (block.typ == shown_block.typ && block.ori == shown_block.ori)
+            return;
+        shown_block = block;
+        werase(w);
         box(w, 0, 0);
         if (block.typ == -1) {
             wnoutrefresh(w);
@@ -59,18 +107,72 @@ namespace tetris{
     }
 
     /*
-    Display score information in a dedicated window.
+    Display score information in a dedicated window, if it changed.
     */
-    void visual_game::display_score(WINDOW* w, tetris_game& tg)
+    void visual_game::display_score(WINDOW* w, const tetris_frame& f)
     {
-    wclear(w);
+    TRACE_SPAN("display_score");
+    if (f.points == shown_points && f.level == shown_level &&
+        f.lines_remaining == shown_lines)
+        return;
+    shown_points = f.points;
+    shown_level = f.level;
+    shown_lines = f.lines_remaining;
+    werase(w);
     box(w, 0, 0);
-    wprintw(w, "Score\n%d\n", tg.get_points());
-    wprintw(w, "Level\n%d\n", tg.get_level());
-    wprintw(w, "Lines\n%d\n", tg.get_lines_remaining());
+    wprintw(w, "Score\n%d\n", f.points);
+    wprintw(w, "Level\n%d\n", f.level);
+    wprintw(w, "Lines\n%d\n", f.lines_remaining);
     wnoutrefresh(w);
     }
 
+    void visual_game::display(const tetris_frame& f)
+    {
+    using clock = std::chrono::steady_clock;
+    clock::time_point t0, t1, t2, t3, t4;
+    TRACE_SPAN("display");
+    t0 = clock::now();
+    display_board(board, f);
+    t1 = clock::now();
+    display_piece(next, f.next, shown_next);
+    display_piece(hold, f.stored, shown_hold);
+    t2 = clock::now();
+    display_score(score, f);
+    t3 = clock::now();
+    {
+    TRACE_SPAN("doupdate");
+    doupdate();
+    }
+    t4 = clock::now();
+    board_time.th_record(t1 - t0);
+    piece_time.th_record(t2 - t1);
+    score_time.th_record(t3 - t2);
+    update_time.th_record(t4 - t3);
+
+    // Every key the frame has played is now on screen.
+    for (; keys_shown < f.inputs && !key_times.empty(); keys_shown++) {
+        key_latency.th_record(t4 - key_times.front());
+        key_times.pop_front();
+    }
+    }
+
+    /*
+    Input is from a key coming in to the frame showing it leaving doupdate().
+    Wake late is how long after its deadline poll() woke the simulation.
+    The other rows time each call.
+    */
+    void visual_game::report(FILE *f) const
+    {
+    tetris_histogram::th_print_header(f);
+    key_latency.th_print(f, "input");
+    tick_time.th_print(f, "tg_tick");
+    wake_late.th_print(f, "wake late");
+    board_time.th_print(f, "display_board");
+    piece_time.th_print(f, "display_piece");
+    score_time.th_print(f, "display_score");
+    update_time.th_print(f, "doupdate");
+    }
+
     /*
     Do the NCURSES initialization steps for color blocks.
     */
@@ -86,8 +188,17 @@ namespace tetris{
     init_pair(TC_CELLZ, COLOR_RED, COLOR_BLACK);
     }
 
-    visual_game::visual_game() : tg(22,10){
+    visual_game::visual_game(const char *record)
+        : tg(22, 10, time(nullptr)), keys_shown(0){
         // create new game.
+        if (record && !recorder.trc_open(record, tg))
+            fprintf(stderr, "can't record %s\n", record);
+        if (pipe(input_pipe) != 0 || pipe(frame_pipe) != 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        for (int fd : {input_pipe[0], input_pipe[1], frame_pipe[0], frame_pipe[1]})
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
         // NCURSES initialization:
         initscr();             // initialize curses
         cbreak();              // pass key presses to program, but not signals
@@ -96,63 +207,249 @@ namespace tetris{
         timeout(0);            // no blocking on getch()
         curs_set(0);           // set the cursor to invisible
         init_colors();         // setup tetris colors
+        refresh();             // clear the screen now, not at the first getch()
 
         // Create windows for each section of the interface.
         board = newwin(tg.get_rows() + 2, 2 * tg.get_cols() + 2, 0, 0);
         next  = newwin(6, 10, 0, 2 * (tg.get_cols() + 1) + 1);
         hold  = newwin(6, 10, 7, 2 * (tg.get_cols() + 1) + 1);
         score = newwin(6, 10, 14, 2 * (tg.get_cols() + 1 ) + 1);
+
+        // Nothing is on screen yet.
+        shown_next = shown_hold = tetris_block{-2, 0, {0, 0}};
+        shown_points = shown_level = shown_lines = -1;
+        reset_board(board);
+    }
+
+    /*
+    Commands to the simulation thread, besides moves.
+    */
+    constexpr char INPUT_PAUSE = 'p';
+    constexpr char INPUT_RESUME = 'r';
+    constexpr char INPUT_QUIT = 'q';
+    static_assert(TM_NONE < INPUT_PAUSE, "commands don't look like moves");
+
+    /*
+    Set by SIGUSR1 to have run() print a report.
+    */
+    static volatile std::sig_atomic_t report_requested = 0;
+
+    static void request_report(int)
+    {
+        report_requested = 1;
     }
 
+    /*
+    Turn a key into the move it makes.  Returns false for keys that aren't moves.
+    */
+    static bool key_move(int key, tetris_move &move)
+    {
+        switch (key) {
+            case KEY_LEFT:
+                move = TM_LEFT;
+                return true;
+            case KEY_RIGHT:
+                move = TM_RIGHT;
+                return true;
+            case KEY_UP:
+                move = TM_CLOCK;
+                return true;
+            case KEY_DOWN:
+                move = TM_DROP;
+                return true;
+            case ' ':
+                move = TM_HOLD;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool visual_game::send(char input)
+    {
+        // Only fails if the simulation is 64K moves behind; drop them then.
+        return write(input_pipe[1], &input, 1) == 1;
+    }
+
+    void visual_game::pause()
+    {
+        const tetris_frame &f = frames.get_front();
+        send(INPUT_PAUSE);
+        werase(board);
+        box(board, 0, 0);
+        wmove(board, f.rows/2, (f.cols*COLS_PER_CELL-6)/2);
+        wprintw(board, "PAUSED");
+        wrefresh(board);
+        timeout(-1);
+        getch();
+        timeout(0);
+        send(INPUT_RESUME);
+        reset_board(board);
+        display(f);
+    }
+
+    /*
+    Tick k of the game falls due TICK_PERIOD * k after it starts, so gravity
+    keeps to the wall clock however slowly the screen is drawn.  Between ticks
+    the thread sleeps in poll() until the next tick that shows anything or some
+    input comes in.  Moves are queued and played one per tick, and the first may
+    run its tick up to a period early so it is seen at once.
+    */
+    void visual_game::simulate()
+    {
+        using clock = std::chrono::steady_clock;
+        clock::time_point start = clock::now();
+        std::deque<tetris_move> moves;
+        struct pollfd input = {input_pipe[0], POLLIN, 0};
+        char buffer[64];
+        tetris_move move;
+        long played = 0, due, wait;
+        std::uint64_t inputs = 0;
+        clock::time_point now, deadline;
+        ssize_t i, n;
+        bool running = true, paused = false, changed = false;
+        int timeout;
+        TRACE_THREAD("simulation");
+        // Play the ticks that are due by now.
+        auto play = [&]() {
+            due = (clock::now() - start) / TICK_PERIOD;
+            if (due - played > MAX_CATCH_UP) {
+                // Stopped for a long while (suspended, say): carry on from now.
+                start += (due - played) * TICK_PERIOD;
+                due = played;
+            }
+            if (!moves.empty() && due == played)
+                due++;
+            for (; running && played < due; played++) {
+                move = TM_NONE;
+                if (!moves.empty()) {
+                    move = moves.front();
+                    moves.pop_front();
+                    inputs++;
+                }
+                now = clock::now();
+                running = tg.tg_tick(move);
+                tick_time.th_record(clock::now() - now);
+                recorder.trc_record(tg, move);
+                changed = true;
+            }
+        };
+        while (running) {
+            while (running && (n = read(input_pipe[0], buffer,
+                                        sizeof(buffer))) > 0) {
+                for (i = 0; running && i < n; i++) {
+                    if (buffer[i] == INPUT_QUIT) {
+                        running = false;
+                    } else if (buffer[i] == INPUT_PAUSE) {
+                        play();
+                        paused = true;
+                    } else if (buffer[i] == INPUT_RESUME) {
+                        // The time spent paused isn't made up afterwards.
+                        paused = false;
+                        start = clock::now() - played * TICK_PERIOD;
+                    } else {
+                        moves.push_back((tetris_move) buffer[i]);
+                    }
+                }
+            }
+            if (running && !paused)
+                play();
+
+            if (changed || !running) {
+                TRACE_SPAN("publish");
+                frames.get_back().tf_capture(tg, running, inputs);
+                frames.tfb_publish();
+                // If the pipe is full the screen has a wakeup coming already.
+                write(frame_pipe[1], "", 1);
+                changed = false;
+            }
+            if (!running)
+                break;
+
+            // Nothing shows until gravity acts, unless there are moves to make.
+            timeout = -1;
+            if (!paused) {
+                wait = moves.empty() ? std::max(tg.get_ticks_till_gravity(), 1)
+                                     : 1;
+                deadline = start + (played + wait) * TICK_PERIOD;
+                timeout = std::max<long>(
+                    std::chrono::ceil<std::chrono::milliseconds>(
+                        deadline - clock::now()).count(), 0);
+            }
+            if (poll(&input, 1, timeout) == 0 && timeout >= 0)
+                wake_late.th_record(clock::now() - deadline);
+        }
+    }
+
+    /*
+    The game runs on its own thread (simulate) and hands frames to this one
+    through a triple buffer, so drawing never holds up a tick.  This thread
+    owns the terminal: it reads keys and sends them on, and draws the newest
+    frame whenever one comes in, skipping any it was too slow for.
+    */
     //TODO: enable the game to run multiple times
     void visual_game::run(){
-        tetris_move move = TM_NONE;
+        struct pollfd fds[2] = {
+            {STDIN_FILENO, POLLIN, 0}, {frame_pipe[0], POLLIN, 0}
+        };
+        struct sigaction action = {};
+        sigset_t usr1, mask;
+        char buffer[64];
+        std::chrono::steady_clock::time_point woke;
+        tetris_move move;
         bool running = true;
+        int key;
+        TRACE_THREAD("screen");
+
+        // SIGUSR1 asks for a report.  It is kept from the simulation thread, so
+        // it lands here and breaks into poll() (no SA_RESTART).
+        action.sa_handler = request_report;
+        sigaction(SIGUSR1, &action, nullptr);
+        sigemptyset(&usr1);
+        sigaddset(&usr1, SIGUSR1);
+
+        key_times.clear();
+        keys_shown = 0;
+        frames.get_back().tf_capture(tg, true, 0);
+        frames.tfb_publish();
+        frames.tfb_update();
+        display(frames.get_front());
+        pthread_sigmask(SIG_BLOCK, &usr1, &mask);
+        std::thread simulation(&visual_game::simulate, this);
+        pthread_sigmask(SIG_SETMASK, &mask, nullptr);
+
         // Game loop
         while (running) {
-            running = tg.tg_tick(move);
-            display_board(board, tg);
-            display_piece(next, tg.get_next());
-            display_piece(hold, tg.get_stored());
-            display_score(score, tg);
-            doupdate();
-            sleep_milli(10);
-
-            switch (getch()) {
-                case KEY_LEFT:
-                    move = TM_LEFT;
-                    break;
-                case KEY_RIGHT:
-                    move = TM_RIGHT;
-                    break;
-                case KEY_UP:
-                    move = TM_CLOCK;
-                    break;
-                case KEY_DOWN:
-                    move = TM_DROP;
-                    break;
-                case 'q':
-                    running = false;
-                    move = TM_NONE;
-                    break;
-                case 'p':
-                    wclear(board);
-                    box(board, 0, 0);
-                    wmove(board, tg.get_rows()/2, (tg.get_cols()*COLS_PER_CELL-6)/2);
-                    wprintw(board, "PAUSED");
-                    wrefresh(board);
-                    timeout(-1);
-                    getch();
-                    timeout(0);
-                    move = TM_NONE;
-                    break;
-                case ' ':
-                    move = TM_HOLD;
-                    break;
-                default:
-                    move = TM_NONE;
+            poll(fds, 2, -1);
+            woke = std::chrono::steady_clock::now();
+            if (report_requested) {
+                report_requested = 0;
+                report(stderr);
+                // Put back the screen if the report was written over it.
+                if (isatty(STDERR_FILENO)) {
+                    clearok(curscr, TRUE);
+                    doupdate();
+                }
+            }
+            while (read(frame_pipe[0], buffer, sizeof(buffer)) > 0) {
+            }
+            while ((key = getch()) != ERR) {
+                if (key_move(key, move)) {
+                    // A dropped key never shows, so it isn't timed.
+                    if (send(move))
+                        key_times.push_back(woke);
+                } else if (key == 'q') {
+                    send(INPUT_QUIT);
+                } else if (key == 'p') {
+                    pause();
+                }
+            }
+            if (frames.tfb_update()) {
+                display(frames.get_front());
+                running = frames.get_front().running;
             }
         }
+        simulation.join();
 
         // Output ending message.
         printf("Game over!\n");
@@ -163,5 +460,10 @@ namespace tetris{
         // Deinitialize NCurses
         wclear(stdscr);
         endwin();
+        report(stderr);
+        close(input_pipe[0]);
+        close(input_pipe[1]);
+        close(frame_pipe[0]);
+        close(frame_pipe[1]);
     }
 }
\ No newline at end of file
@@ -1,28 +1,77 @@
 #pragma once
 #include <ncurses.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
 
+#include "tetris_frame.hpp"
 #include "tetris_game.hpp"
+#include "tetris_histogram.hpp"
+#include "tetris_replay.hpp"
 
 namespace tetris{
     //2 columns per cell makes the game much nicer.
     constexpr unsigned short COLS_PER_CELL = 2;
+    //a row of cells that can't be on screen, to force a redraw.
+    constexpr tetris_color_row CELL_UNDRAWN = 0x8888888888888888ULL;
+    //time between game ticks.
+    constexpr std::chrono::milliseconds TICK_PERIOD(10);
+    //most ticks played at once to catch up with the clock.
+    constexpr long MAX_CATCH_UP = 100;
     class visual_game{
         private:
             WINDOW *board, *next, *hold, *score;
+            //the game and its recording belong to the simulation thread.
             tetris_game tg;
+            tetris_recorder recorder;
+            //frames from the simulation thread to the screen.
+            tetris_frame_buffer frames;
+            //moves and commands to the simulation thread, and a byte back
+            //for each frame published, so either side can wait in poll().
+            int input_pipe[2], frame_pipe[2];
+            //when each key sent to the simulation thread came in, until a
+            //frame showing it is on screen, and how many keys have been.
+            std::deque<std::chrono::steady_clock::time_point> key_times;
+            std::uint64_t keys_shown;
+            //timings, each written by one thread; see report().
+            tetris_histogram key_latency, tick_time, wake_late;
+            tetris_histogram board_time, piece_time, score_time, update_time;
+            //what the windows show now, so a frame only draws what changed.
+            std::array<tetris_color_row, MAX_ROWS> shown;
+            tetris_block shown_next, shown_hold;
+            int shown_points, shown_level, shown_lines;
 
             //print a cell of a specific type to a window.
             inline void ADD_BLOCK(WINDOW* w, char x);
             inline void ADD_EMPTY(WINDOW* w);
-            void display_board(WINDOW *w, tetris_game& tg);
+            //print the outline of a cell where the falling block will land.
+            inline void ADD_GHOST(WINDOW* w, char x);
+            void display_board(WINDOW *w, const tetris_frame& f);
+            // Redraw the whole board on the next frame.
+            void reset_board(WINDOW *w);
             // Display a tetris piece in a dedicated window.
-            void display_piece(WINDOW* w, tetris_block block);
+            void display_piece(WINDOW* w, tetris_block block,
+                               tetris_block &shown_block);
             // Display score information in a dedicated window.
-            void display_score(WINDOW* w, tetris_game& tg);
+            void display_score(WINDOW* w, const tetris_frame& f);
+            // Draw whatever changed in a frame.
+            void display(const tetris_frame& f);
+            // Show the pause screen until a key is pressed.
+            void pause();
+            // Tick the game on time and publish frames until it ends.
+            void simulate();
+            // Send a move or command to the simulation thread; false if it
+            // was dropped.
+            bool send(char input);
+            // Print the timings as a table of percentiles.
+            void report(FILE *f) const;
             // Do the NCURSES initialization steps for color blocks.
             void init_colors();
         public:
-            visual_game();
+            // Record a replay of the game to record, if given.
+            visual_game(const char *record = nullptr);
             void run();
             ~visual_game();
     };